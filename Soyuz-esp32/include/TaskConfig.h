@@ -0,0 +1,40 @@
+/*
+  Task topology. Every task's core, priority and stack lives here. Tasks are
+  started with startTask, the libraries that own one take its TaskConfig in
+  begin().
+
+  Core 0 runs the WiFi/LwIP stack (priorities 18-23), so network, logging and
+  audio stay there below it. Core 1 is kept for the clock: the time task sits
+  above the Arduino loop task (priority 1), which does the display writes.
+*/
+
+#ifndef TaskConfig_h
+#define TaskConfig_h
+#include <Arduino.h>
+
+struct TaskConfig
+{
+  const char *name;
+  uint32_t stackSize;
+  UBaseType_t priority;
+  BaseType_t core;
+};
+
+constexpr TaskConfig timeTaskConfig = {"updateDateTimeTask", 4096, 5, 1};
+constexpr TaskConfig stopWatchTaskConfig = {"stopWatchTask", 4096, 4, 1};
+constexpr TaskConfig animationTaskConfig = {"animationTask", 3072, 3, 1}; // below the tick, skips frames rather than wait
+// audio on core 0 so the MP3 decoder never competes with the display. move it to
+// core 1 if heavy WiFi traffic starves the DMA refills
+constexpr TaskConfig audioTaskConfig = {"audioTask", 8192, 3, 0};
+constexpr TaskConfig assetReaderTaskConfig = {"assetReaderTask", 4096, 4, 0}; // refills preempt the decoder
+constexpr TaskConfig networkTaskConfig = {"networkTask", 8192, 2, 0}; // WiFiManager, its web server and the API
+constexpr TaskConfig syncTaskConfig = {"syncTask", 4096, 4, 0}; // above the network task so beacon stamps are not held up
+constexpr TaskConfig logTaskConfig = {"logDrainTask", 3072, 1, 0};
+constexpr TaskConfig wifiStressTaskConfig = {"wifiStressTask", 4096, 2, 0}; // SOYUZ_WIFI_STRESS builds only
+
+inline BaseType_t startTask(TaskFunction_t function, const TaskConfig &config, void *parameter = NULL, TaskHandle_t *handle = NULL)
+{
+  return xTaskCreatePinnedToCore(function, config.name, config.stackSize, parameter, config.priority, handle, config.core);
+}
+
+#endif
@@ -0,0 +1,99 @@
+/*
+*/
+
+#ifdef SOYUZ_ALLOC_TRACE
+
+#include "Arduino.h"
+#include "SoyuzAlloc.h"
+#include <assert.h>
+#include <atomic>
+
+static const char *subsystemNames[ALLOC_SUBSYSTEMS] = {"other", "clock", "display", "settings"};
+
+static std::atomic<uint32_t> allocCounts[ALLOC_SUBSYSTEMS];
+static std::atomic<uint32_t> allocBytes[ALLOC_SUBSYSTEMS];
+static uint32_t steadyStateCounts[ALLOC_SUBSYSTEMS];
+static bool steadyState = false;
+static __thread uint8_t currentSubsystem = ALLOC_OTHER;
+
+extern "C"
+{
+    void *__real_malloc(size_t size);
+    void *__real_calloc(size_t n, size_t size);
+    void *__real_realloc(void *ptr, size_t size);
+
+    void *__wrap_malloc(size_t size)
+    {
+        SoyuzAlloc::record(size);
+        return __real_malloc(size);
+    }
+
+    void *__wrap_calloc(size_t n, size_t size)
+    {
+        SoyuzAlloc::record(n * size);
+        return __real_calloc(n, size);
+    }
+
+    void *__wrap_realloc(void *ptr, size_t size)
+    {
+        SoyuzAlloc::record(size);
+        return __real_realloc(ptr, size);
+    }
+}
+
+void SoyuzAlloc::record(size_t size)
+{
+    allocCounts[currentSubsystem].fetch_add(1, std::memory_order_relaxed);
+    allocBytes[currentSubsystem].fetch_add(size, std::memory_order_relaxed);
+}
+
+uint32_t SoyuzAlloc::count(uint8_t subsystem)
+{
+    return allocCounts[subsystem].load(std::memory_order_relaxed);
+}
+
+void SoyuzAlloc::markSteadyState()
+{
+    for (int i = 0; i < ALLOC_SUBSYSTEMS; i++)
+        steadyStateCounts[i] = count(i);
+    steadyState = true;
+}
+
+// the settings path still gets one String per field from the web server,
+// so only the clock and display paths have to be allocation free
+void SoyuzAlloc::checkSteadyState()
+{
+    if (!steadyState)
+        return;
+    for (int i = ALLOC_CLOCK; i <= ALLOC_DISPLAY; i++)
+    {
+        if (count(i) != steadyStateCounts[i])
+        {
+            report();
+            assert(!"heap allocation in steady state");
+        }
+    }
+}
+
+void SoyuzAlloc::report()
+{
+    // printf straight to the console, the logger is not an option while we count mallocs
+    for (int i = 0; i < ALLOC_SUBSYSTEMS; i++)
+    {
+        printf("[alloc] %-8s %lu allocs %lu bytes (%lu since steady state)\n", subsystemNames[i],
+               (unsigned long)count(i), (unsigned long)allocBytes[i].load(std::memory_order_relaxed),
+               (unsigned long)(steadyState ? count(i) - steadyStateCounts[i] : 0));
+    }
+}
+
+SoyuzAlloc::Scope::Scope(uint8_t subsystem) : previous(currentSubsystem)
+{
+    currentSubsystem = subsystem;
+}
+
+SoyuzAlloc::Scope::~Scope()
+{
+    currentSubsystem = previous;
+}
+
+#endif
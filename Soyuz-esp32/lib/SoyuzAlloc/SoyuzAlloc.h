@@ -0,0 +1,68 @@
+/*
+  Debug allocation tracking. Build with SOYUZ_ALLOC_TRACE and
+  -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc (see the alloc-trace env in
+  platformio.ini) to count heap allocations per subsystem. Code marks which
+  subsystem it belongs to with ALLOC_SCOPE, and ALLOC_CHECK_STEADY_STATE
+  asserts that the clock paths have not allocated since boot finished.
+  Without SOYUZ_ALLOC_TRACE all of this compiles away.
+*/
+
+#ifndef SoyuzAlloc_h
+#define SoyuzAlloc_h
+#include "Arduino.h"
+
+enum AllocSubsystem
+{
+  ALLOC_OTHER, // wifi, libraries, anything not tagged
+  ALLOC_CLOCK,
+  ALLOC_DISPLAY,
+  ALLOC_SETTINGS,
+  ALLOC_SUBSYSTEMS
+};
+
+#ifdef SOYUZ_ALLOC_TRACE
+
+class SoyuzAlloc
+{
+public:
+  static void record(size_t size);
+  static uint32_t count(uint8_t subsystem);
+  static void markSteadyState();
+  static void checkSteadyState();
+  static void report();
+
+  class Scope // tags allocations made by this task until it goes out of scope
+  {
+  public:
+    Scope(uint8_t subsystem);
+    ~Scope();
+
+  private:
+    uint8_t previous;
+  };
+};
+
+#define ALLOC_CONCAT_(a, b) a##b
+#define ALLOC_CONCAT(a, b) ALLOC_CONCAT_(a, b)
+#define ALLOC_SCOPE(subsystem) SoyuzAlloc::Scope ALLOC_CONCAT(allocScope, __LINE__)(subsystem)
+#define ALLOC_MARK_STEADY_STATE() SoyuzAlloc::markSteadyState()
+#define ALLOC_CHECK_STEADY_STATE() SoyuzAlloc::checkSteadyState()
+
+#else
+
+#define ALLOC_SCOPE(subsystem) \
+  do                           \
+  {                            \
+  } while (0)
+#define ALLOC_MARK_STEADY_STATE() \
+  do                              \
+  {                               \
+  } while (0)
+#define ALLOC_CHECK_STEADY_STATE() \
+  do                               \
+  {                                \
+  } while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,132 @@
+/*
+*/
+
+#include "Arduino.h"
+#include "SoyuzApi.h"
+#include "SoyuzLog.h"
+
+SoyuzApi::SoyuzApi(uint16_t httpPort, uint16_t wsPort)
+    : http(httpPort), ws(wsPort), routes(), routeCount(0), lastFrame(), started(false)
+{
+}
+
+bool SoyuzApi::on(const char *uri, JsonWriter get, PostHandler post)
+{
+    if (routeCount >= maxRoutes)
+        return false;
+    routes[routeCount++] = {uri, get, post};
+    return true;
+}
+
+void SoyuzApi::begin()
+{
+    if (started)
+        return;
+    for (int i = 0; i < routeCount; i++)
+    {
+        const Route &route = routes[i];
+        http.on(route.uri, HTTP_GET, [this, &route]()
+                { serve(route, false); });
+        if (route.post)
+            http.on(route.uri, HTTP_POST, [this, &route]()
+                    { serve(route, true); });
+    }
+    http.onNotFound([this]()
+                    { http.send(404, "application/json", "{\"error\":\"not found\"}"); });
+    http.begin();
+    ws.onEvent([this](uint8_t num, WStype_t type, uint8_t *payload, size_t length)
+               { onSocketEvent(num, type, payload, length); });
+    ws.begin();
+    started = true;
+}
+
+void SoyuzApi::handle()
+{
+    if (!started)
+        return;
+    http.handleClient();
+    ws.loop();
+}
+
+void SoyuzApi::pushFrame(const uint8_t *frame)
+{
+    if (!started || memcmp(frame, lastFrame, frameSize) == 0)
+        return;
+    memcpy(lastFrame, frame, frameSize);
+    if (ws.connectedClients())
+        ws.broadcastBIN(lastFrame, frameSize);
+}
+
+bool SoyuzApi::intArg(WebServer &server, const char *name, int min, int max, int &value)
+{
+    if (!server.hasArg(name))
+        return false;
+    const String &text = server.arg(name);
+    if (text.length() == 0 || text.length() > 9)
+        return false;
+    for (unsigned int i = 0; i < text.length(); i++)
+    {
+        if (text[i] < '0' || text[i] > '9')
+            return false;
+    }
+    value = text.toInt();
+    return value >= min && value <= max;
+}
+
+const char *SoyuzApi::jsonEscape(const char *text, char *out, size_t size)
+{
+    if (size == 0)
+        return out;
+    size_t n = 0;
+    for (; *text; text++)
+    {
+        unsigned char c = *text;
+        char escaped[7];
+        int length = 1;
+        if (c == '"' || c == '\\')
+            length = snprintf(escaped, sizeof(escaped), "\\%c", c);
+        else if (c < 0x20)
+            length = snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+        else
+            escaped[0] = c;
+        if (n + length >= size)
+            break; // never half an escape
+        memcpy(out + n, escaped, length);
+        n += length;
+    }
+    out[n] = '\0';
+    return out;
+}
+
+void SoyuzApi::serve(const Route &route, bool isPost)
+{
+    if (isPost)
+    {
+        if (route.post(http))
+            http.send(202); // queued for the clock loop, GET shows it once applied
+        else
+            http.send(400, "application/json", "{\"error\":\"bad request\"}");
+        return;
+    }
+    int length = route.get(response, sizeof(response));
+    if (length < 0 || length >= (int)sizeof(response))
+    {
+        LOG_WARN(LOG_CAT_NET, "api response too long for %d bytes", (int)sizeof(response));
+        http.send(500, "application/json", "{\"error\":\"response too long\"}");
+        return;
+    }
+    http.send_P(200, "application/json", response, length); // straight from the buffer, no String copy
+}
+
+void SoyuzApi::onSocketEvent(uint8_t num, WStype_t type, uint8_t *, size_t)
+{
+    if (type == WStype_CONNECTED)
+    {
+        LOG_INFO(LOG_CAT_NET, "ws client %d connected, %d total", num, ws.connectedClients());
+        ws.sendBIN(num, lastFrame, frameSize); // start from the current frame
+    }
+    else if (type == WStype_DISCONNECTED)
+    {
+        LOG_INFO(LOG_CAT_NET, "ws client %d disconnected", num);
+    }
+}
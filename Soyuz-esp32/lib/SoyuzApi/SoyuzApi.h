@@ -0,0 +1,65 @@
+/*
+  Small local control API. JSON over HTTP for reading and changing clock
+  state, and a WebSocket that pushes the display frame (10 segment bytes,
+  position 0 first) whenever it changes, so a dashboard can mirror the
+  clock without polling.
+
+  A POST only queues the change for the clock's own loop to apply, so it
+  answers 202 with no body and a GET afterwards shows the new state.
+
+  Responses are formatted into one buffer allocated up front, and the
+  WebSocket client count is capped by WEBSOCKETS_SERVER_CLIENT_MAX. Both
+  servers are serviced from handle(), which belongs on the network core.
+  test/host/test_api runs the routing and argument checks against stubs.
+*/
+
+#ifndef SoyuzApi_h
+#define SoyuzApi_h
+#include "Arduino.h"
+#include <WebServer.h>
+#include <WebSocketsServer.h>
+
+class SoyuzApi
+{
+public:
+  static const int maxRoutes = 8;
+  static const size_t responseSize = 512;
+  static const size_t frameSize = 10;
+
+  typedef int (*JsonWriter)(char *out, size_t size); // snprintf style, returns the length
+  typedef bool (*PostHandler)(WebServer &server);    // false answers 400
+
+  SoyuzApi(uint16_t httpPort = 8080, uint16_t wsPort = 8081);
+  bool on(const char *uri, JsonWriter get, PostHandler post = NULL); // before begin()
+  void begin();
+  void handle();
+  void pushFrame(const uint8_t *frame); // sent to every client if it differs from the last one
+  uint8_t clientCount() { return ws.connectedClients(); }
+
+  // for PostHandlers. false if the field is missing, not a whole number or outside min..max
+  static bool intArg(WebServer &server, const char *name, int min, int max, int &value);
+  // for JsonWriters. text with quotes, backslashes and control characters escaped, cut short
+  // rather than overflow out. returns out, to go straight into a "%s"
+  static const char *jsonEscape(const char *text, char *out, size_t size);
+
+private:
+  struct Route
+  {
+    const char *uri;
+    JsonWriter get;
+    PostHandler post;
+  };
+
+  void serve(const Route &route, bool isPost);
+  void onSocketEvent(uint8_t num, WStype_t type, uint8_t *payload, size_t length);
+
+  WebServer http;
+  WebSocketsServer ws;
+  Route routes[maxRoutes];
+  int routeCount;
+  char response[responseSize];
+  uint8_t lastFrame[frameSize];
+  bool started;
+};
+
+#endif
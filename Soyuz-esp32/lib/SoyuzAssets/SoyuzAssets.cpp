@@ -0,0 +1,237 @@
+/*
+*/
+
+#include "Arduino.h"
+#include "SoyuzAssets.h"
+#include "SoyuzLog.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+// FNV-1a, ignoring a leading slash so "/a.mp3" and "a.mp3" are the same asset
+uint32_t SoyuzAssets::hash(const char *name)
+{
+    if (*name == '/')
+        name++;
+    uint32_t h = 2166136261UL;
+    while (*name)
+    {
+        h ^= (uint8_t)*name++;
+        h *= 16777619UL;
+    }
+    return h;
+}
+
+int SoyuzAssets::begin(fs::FS &filesystem, const char *dir)
+{
+    card = &filesystem;
+    assetCount = 0;
+    File root = card->open(dir);
+    if (!root || !root.isDirectory())
+        return 0;
+    File entry;
+    while ((entry = root.openNextFile()) && assetCount < maxAssets)
+    {
+        const char *path = entry.path();
+        if (!entry.isDirectory() && strlen(path) < sizeof(assets[0].path))
+        {
+            Asset &asset = assets[assetCount++];
+            asset.hash = hash(entry.name());
+            asset.size = entry.size();
+            strlcpy(asset.path, path, sizeof(asset.path));
+        }
+        entry.close();
+    }
+    root.close();
+    LOG_INFO(LOG_CAT_AUDIO, "assets: %d files indexed", assetCount);
+    return assetCount;
+}
+
+// the file name part of a path, what the index hashes
+static const char *baseName(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+SoyuzAssets::Asset *SoyuzAssets::lookup(const char *name)
+{
+    uint32_t h = hash(name);
+    if (*name == '/')
+        name++;
+    for (int i = 0; i < assetCount; i++)
+    {
+        if (assets[i].hash == h && strcmp(baseName(assets[i].path), name) == 0)
+            return &assets[i];
+    }
+    return NULL;
+}
+
+const SoyuzAssets::Asset *SoyuzAssets::find(const char *name)
+{
+    return lookup(name);
+}
+
+File SoyuzAssets::open(const char *name)
+{
+    Asset *asset = lookup(name);
+    if (!asset)
+        return File();
+    if (asset->file)
+    {
+        asset->file.seek(0);
+        return asset->file;
+    }
+    File file = card->open(asset->path);
+    if (file && openCount < maxOpenFiles) // keep it for next time
+    {
+        asset->file = file;
+        openCount++;
+    }
+    return file;
+}
+
+AssetReader::AssetReader(size_t chunkSize)
+    : chunk(chunkSize), buffers(), current(0), file(NULL), eof(true), task(NULL), ioMutex(NULL),
+      bytes(0), readTimeUs(0), stalls(0), stalled(false), readLatency(50000)
+{
+}
+
+bool AssetReader::begin(const TaskConfig &config)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        buffers[i].data = (uint8_t *)heap_caps_malloc(chunk, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!buffers[i].data)
+            buffers[i].data = (uint8_t *)heap_caps_malloc(chunk, MALLOC_CAP_DMA | MALLOC_CAP_8BIT);
+        if (!buffers[i].data)
+            return false;
+    }
+    ioMutex = xSemaphoreCreateMutex();
+    return startTask(readerTask, config, this, &task) == pdPASS;
+}
+
+void AssetReader::open(File &f)
+{
+    xSemaphoreTake(ioMutex, portMAX_DELAY);
+    file = &f;
+    current = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        buffers[i].len.store(0, std::memory_order_relaxed);
+        buffers[i].pos.store(0, std::memory_order_relaxed);
+        buffers[i].ready.store(false, std::memory_order_relaxed);
+    }
+    eof.store(false, std::memory_order_release);
+    xSemaphoreGive(ioMutex);
+    xTaskNotifyGive(task);
+}
+
+bool AssetReader::finished()
+{
+    return eof.load(std::memory_order_acquire) && currentBuffer() == NULL;
+}
+
+void AssetReader::readerTask(void *parameter)
+{
+    AssetReader *reader = static_cast<AssetReader *>(parameter);
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        reader->fill();
+    }
+}
+
+// refill every drained buffer with one large read each
+void AssetReader::fill()
+{
+    xSemaphoreTake(ioMutex, portMAX_DELAY);
+    bool end = eof.load(std::memory_order_relaxed); // only this task sets it
+    for (int n = 0; n < 2 && !end; n++)
+    {
+        Buffer &buffer = buffers[(current + n) & 1];
+        if (buffer.ready.load(std::memory_order_acquire)) // still the consumer's
+            continue;
+        uint32_t start = esp_timer_get_time();
+        size_t len = file->read(buffer.data, chunk);
+        uint32_t us = (uint32_t)esp_timer_get_time() - start;
+        readLatency.record(us);
+        readTimeUs += us;
+        bytes += len;
+        buffer.len.store(len, std::memory_order_relaxed);
+        buffer.pos.store(0, std::memory_order_relaxed);
+        buffer.ready.store(len > 0, std::memory_order_release); // publishes data, len and pos
+        end = len < chunk;
+    }
+    if (end)
+        eof.store(true, std::memory_order_release); // after the last buffer, so finished() can't jump ahead of it
+    xSemaphoreGive(ioMutex);
+}
+
+// the buffer to read from, swapping to the next one when it runs dry. NULL if none is ready
+AssetReader::Buffer *AssetReader::currentBuffer()
+{
+    Buffer *buffer = &buffers[current];
+    if (buffer->ready.load(std::memory_order_acquire) &&
+        buffer->pos.load(std::memory_order_relaxed) >= buffer->len.load(std::memory_order_relaxed))
+    {
+        buffer->ready.store(false, std::memory_order_release); // hands it back, done reading data
+        current ^= 1;
+        xTaskNotifyGive(task);
+        buffer = &buffers[current];
+    }
+    return buffer->ready.load(std::memory_order_acquire) ? buffer : NULL;
+}
+
+int AssetReader::available()
+{
+    Buffer *buffer = currentBuffer();
+    if (!buffer)
+    {
+        if (!eof.load(std::memory_order_relaxed) && !stalled)
+            stalls++;
+        stalled = true;
+        return 0;
+    }
+    stalled = false;
+    return buffer->len.load(std::memory_order_relaxed) - buffer->pos.load(std::memory_order_relaxed);
+}
+
+int AssetReader::read()
+{
+    Buffer *buffer = currentBuffer();
+    return buffer ? buffer->data[buffer->pos.fetch_add(1, std::memory_order_relaxed)] : -1;
+}
+
+int AssetReader::peek()
+{
+    Buffer *buffer = currentBuffer();
+    return buffer ? buffer->data[buffer->pos.load(std::memory_order_relaxed)] : -1;
+}
+
+size_t AssetReader::readBytes(uint8_t *dest, size_t length)
+{
+    size_t total = 0;
+    Buffer *buffer;
+    while (total < length && (buffer = currentBuffer()) != NULL)
+    {
+        size_t pos = buffer->pos.load(std::memory_order_relaxed);
+        size_t n = min(length - total, buffer->len.load(std::memory_order_relaxed) - pos);
+        memcpy(dest + total, buffer->data + pos, n);
+        buffer->pos.store(pos + n, std::memory_order_relaxed);
+        total += n;
+    }
+    return total;
+}
+
+void AssetReader::report()
+{
+    xSemaphoreTake(ioMutex, portMAX_DELAY);
+    LOG_INFO(LOG_CAT_AUDIO, "asset read %u KB/s sustained, %u us avg %u us max per read",
+             readTimeUs ? (uint32_t)((uint64_t)bytes * 1000 / readTimeUs) : 0, readLatency.avg(), readLatency.max());
+    LOG_INFO(LOG_CAT_AUDIO, "asset reader %u stalls, %u reads", stalls, readLatency.count());
+    bytes = 0;
+    readTimeUs = 0;
+    stalls = 0;
+    readLatency.reset();
+    xSemaphoreGive(ioMutex);
+}
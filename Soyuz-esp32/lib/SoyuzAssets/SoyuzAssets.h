@@ -0,0 +1,99 @@
+/*
+  SD card asset layer. SoyuzAssets scans the card once at boot into a small
+  index (name hash -> size, path) and keeps the handles of assets it has
+  opened, so playing a sound again is a seek instead of a directory walk.
+  Only the files directly in the scanned directory are indexed, subdirectories
+  are skipped. A hash hit is confirmed against the stored path, so colliding
+  names can't return the wrong file.
+
+  AssetReader streams a file through two large buffers (PSRAM if there is
+  any) filled by its own task, so readers like the MP3 decoder pull from RAM
+  and never wait on a card read. It keeps read throughput and latency stats.
+  Each buffer is handed over by its ready flag: the reader task fills it and
+  sets ready with release, the consumer drains it and clears ready with
+  release, and each side acquires the flag before touching data, len or pos.
+*/
+
+#ifndef SoyuzAssets_h
+#define SoyuzAssets_h
+#include "Arduino.h"
+#include "FS.h"
+#include "TaskConfig.h"
+#include "SoyuzTiming.h"
+#include <atomic>
+
+class SoyuzAssets
+{
+public:
+  static const int maxAssets = 32;
+  static const int maxOpenFiles = 6; // keep below the max_files SD was mounted with
+
+  struct Asset
+  {
+    uint32_t hash;
+    uint32_t size;
+    char path[32];
+    File file; // kept open once used
+  };
+
+  int begin(fs::FS &fs, const char *dir = "/"); // returns how many assets were indexed, not recursive
+  const Asset *find(const char *name);          // "/sound2.mp3" or "sound2.mp3"
+  File open(const char *name);                  // rewound handle, false if missing
+  int count() const { return assetCount; }
+
+  static uint32_t hash(const char *name);
+
+private:
+  Asset *lookup(const char *name);
+
+  fs::FS *card;
+  Asset assets[maxAssets];
+  int assetCount = 0;
+  int openCount = 0;
+};
+
+class AssetReader : public Stream
+{
+public:
+  AssetReader(size_t chunkSize = 16384); // multiple of the 512 byte sector
+  bool begin(const TaskConfig &config); // buffers and the reader task
+  void open(File &file);
+  bool finished(); // end of file and nothing left buffered
+
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t readBytes(uint8_t *dest, size_t length) override;
+  size_t write(uint8_t) override { return 0; }
+  void flush() override {}
+
+  void report(); // logs throughput and latency since the last report
+
+private:
+  struct Buffer
+  {
+    uint8_t *data;
+    std::atomic<size_t> len;
+    std::atomic<size_t> pos;
+    std::atomic<bool> ready; // owned by the reader task while false, by the consumer while true
+  };
+
+  Buffer *currentBuffer();
+  static void readerTask(void *parameter);
+  void fill();
+
+  size_t chunk;
+  Buffer buffers[2];
+  int current;
+  File *file;
+  std::atomic<bool> eof; // set after the last buffer is published
+  TaskHandle_t task;
+  SemaphoreHandle_t ioMutex;
+  uint32_t bytes;
+  uint32_t readTimeUs;
+  uint32_t stalls; // times the reader asked for data and both buffers were empty
+  bool stalled;
+  LatencyStats readLatency;
+};
+
+#endif
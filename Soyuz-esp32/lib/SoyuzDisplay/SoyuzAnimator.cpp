@@ -0,0 +1,146 @@
+/*
+*/
+
+#include "Arduino.h"
+#include "SoyuzAnimator.h"
+
+// LedControl segment bits
+#define SEG_DP B10000000
+#define SEG_A B01000000
+#define SEG_B B00100000
+#define SEG_C B00010000
+#define SEG_D B00001000
+#define SEG_E B00000100
+#define SEG_F B00000010
+#define SEG_G B00000001
+
+// segment rows, top to bottom, for the wipe
+static const uint8_t wipeRows[5] = {SEG_A, SEG_B | SEG_F, SEG_G, SEG_C | SEG_E, SEG_D};
+
+// move every segment half a digit up (lower ones become upper ones, upper ones fall off)
+static uint8_t rollUp(uint8_t s)
+{
+    return (s & SEG_D ? SEG_G : 0) | (s & SEG_G ? SEG_A : 0) | (s & SEG_C ? SEG_B : 0) | (s & SEG_E ? SEG_F : 0);
+}
+
+static uint8_t rollDown(uint8_t s)
+{
+    return (s & SEG_A ? SEG_G : 0) | (s & SEG_G ? SEG_D : 0) | (s & SEG_B ? SEG_C : 0) | (s & SEG_F ? SEG_E : 0);
+}
+
+SoyuzAnimator::SoyuzAnimator(SoyuzDisplay &output)
+    : display(output), mode(cut), digits(), activeMask(0), timer(NULL), task(NULL), periodUs(0), noise(1)
+{
+}
+
+void SoyuzAnimator::begin(TaskHandle_t frameTask, uint32_t frameUs)
+{
+    task = frameTask;
+    periodUs = frameUs;
+    esp_timer_create_args_t args = {};
+    args.callback = timerCallback;
+    args.arg = this;
+    args.name = "animation";
+    esp_timer_create(&args, &timer);
+}
+
+uint8_t SoyuzAnimator::steps(Transition t)
+{
+    switch (t)
+    {
+    case wipe:
+        return 10;
+    case roll:
+        return 4;
+    case flicker:
+        return 6;
+    default:
+        return 0;
+    }
+}
+
+bool SoyuzAnimator::start(int position, uint8_t from, uint8_t to)
+{
+    if (mode == cut || timer == NULL)
+        return false;
+    digits[position].from = from;
+    digits[position].to = to;
+    digits[position].step = 0;
+    activeMask |= 1 << position;
+    if (!esp_timer_is_active(timer))
+        esp_timer_start_periodic(timer, periodUs); // only runs while something animates
+    return true;
+}
+
+bool SoyuzAnimator::frame()
+{
+    uint16_t mask = activeMask;
+    for (int i = 0; i < 10; i++)
+    {
+        if (!(mask & (1 << i)))
+            continue;
+        DigitAnimation &anim = digits[i];
+        anim.step++;
+        if (anim.step >= steps(mode))
+        {
+            display.writeRaw(i, anim.to);
+            mask &= ~(1 << i);
+        }
+        else
+        {
+            display.writeRaw(i, image(anim));
+        }
+    }
+    activeMask = mask;
+    if (!mask && esp_timer_is_active(timer))
+        esp_timer_stop(timer);
+    return mask != 0;
+}
+
+uint8_t SoyuzAnimator::image(const DigitAnimation &anim)
+{
+    uint8_t dot = anim.to & SEG_DP;
+    switch (mode)
+    {
+    case wipe:
+    {
+        uint8_t rows = 0;
+        if (anim.step < 5)
+        {
+            for (int r = 0; r <= anim.step; r++)
+                rows |= wipeRows[r];
+            return (anim.from & ~rows & ~SEG_DP) | dot;
+        }
+        for (int r = 0; r <= anim.step - 5; r++)
+            rows |= wipeRows[r];
+        return (anim.to & rows) | dot;
+    }
+    case roll:
+        switch (anim.step)
+        {
+        case 1:
+            return rollUp(anim.from) | dot;
+        case 2:
+            return rollUp(rollUp(anim.from)) | rollDown(rollDown(anim.to)) | dot;
+        default:
+            return rollDown(anim.to) | dot;
+        }
+    case flicker:
+    {
+        noise = noise * 1103515245 + 12345; // cheap LCG, good enough for segments
+        uint8_t keep = noise >> 16;
+        if (anim.step & 1)
+            keep |= noise >> 24; // odd frames are brighter, more segments lit
+        return (anim.to & keep) | dot;
+    }
+    default:
+        return anim.to;
+    }
+}
+
+void SoyuzAnimator::timerCallback(void *arg)
+{
+    SoyuzAnimator *anim = static_cast<SoyuzAnimator *>(arg);
+    if (anim->task)
+        xTaskNotifyGive(anim->task);
+}
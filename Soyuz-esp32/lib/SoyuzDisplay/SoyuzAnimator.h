@@ -0,0 +1,57 @@
+/*
+  Per-digit transition engine on top of the SoyuzDisplay frame buffer. When a
+  digit changes the display hands the old and new segment images to start(),
+  and frame() steps every animating digit once. frame() is driven at a fixed
+  rate from an esp_timer and only writes digits whose image changed this
+  frame, at most 10 setRow calls no matter what is going on.
+*/
+
+#ifndef SoyuzAnimator_h
+#define SoyuzAnimator_h
+#include "Arduino.h"
+#include "SoyuzDisplay.h"
+#include "esp_timer.h"
+
+class SoyuzAnimator
+{
+public:
+  enum Transition
+  {
+    cut,     // no animation
+    wipe,    // old digit wiped out top to bottom, new one wiped in
+    roll,    // old digit rolls up out of view, new one rolls in from below
+    flicker, // new digit flickers in like the 744H's display warming up
+    num_transitions
+  };
+
+  SoyuzAnimator(SoyuzDisplay &output);
+  void begin(TaskHandle_t frameTask, uint32_t frameUs); // frameTask is notified every frame
+  void setTransition(Transition t) { mode = t < num_transitions ? t : cut; }
+  Transition transition() const { return mode; }
+  bool start(int position, uint8_t from, uint8_t to); // false if the digit should just be cut
+  bool frame();                                       // one frame, call with the display locked. false when idle
+  bool active() const { return activeMask != 0; }
+
+private:
+  struct DigitAnimation
+  {
+    uint8_t from;
+    uint8_t to;
+    uint8_t step;
+  };
+
+  uint8_t image(const DigitAnimation &anim);
+  static uint8_t steps(Transition t);
+  static void timerCallback(void *arg);
+
+  SoyuzDisplay &display;
+  Transition mode;
+  DigitAnimation digits[10];
+  volatile uint16_t activeMask;
+  esp_timer_handle_t timer;
+  TaskHandle_t task;
+  uint32_t periodUs;
+  uint32_t noise;
+};
+
+#endif
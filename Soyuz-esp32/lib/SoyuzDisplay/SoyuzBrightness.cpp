@@ -0,0 +1,56 @@
+/*
+*/
+
+#include "Arduino.h"
+#include "SoyuzBrightness.h"
+
+// lowest perceptual level for each intensity step. step k has a duty of
+// (2k+1)/32, perceived as duty^(1/2.2), thresholds sit halfway between steps
+static const uint8_t intensityThresholds[16] = {
+    1, 70, 99, 119, 136, 151, 164, 176, 186, 197, 206, 216, 224, 232, 240, 248};
+
+SoyuzBrightness::SoyuzBrightness(SoyuzDisplay &output)
+    : display(output), level(255), start(255), target(255), fadeMs(0), fadeStart(0)
+{
+}
+
+void SoyuzBrightness::setTarget(uint8_t newTarget, uint16_t newFadeMs)
+{
+    if (newTarget == target)
+        return;
+    start = level;
+    target = newTarget;
+    fadeMs = newFadeMs;
+    fadeStart = millis();
+}
+
+void SoyuzBrightness::update()
+{
+    unsigned long elapsed = millis() - fadeStart;
+    if (fadeMs == 0 || elapsed >= fadeMs)
+    {
+        level = target;
+    }
+    else
+    {
+        level = start + ((int)target - (int)start) * (long)elapsed / fadeMs;
+    }
+
+    if (level == 0)
+    {
+        display.setPower(false);
+    }
+    else
+    {
+        display.setIntensity(toIntensity(level));
+        display.setPower(true);
+    }
+}
+
+uint8_t SoyuzBrightness::toIntensity(uint8_t value)
+{
+    uint8_t step = 0;
+    while (step < 15 && value >= intensityThresholds[step + 1])
+        step++;
+    return step;
+}
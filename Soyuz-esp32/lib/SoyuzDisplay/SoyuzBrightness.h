@@ -0,0 +1,34 @@
+/*
+  Brightness controller for the MAX7219s. Levels are perceptual (0-255, 0 is
+  off) and go through a gamma table to the chip's 16 intensity steps, so a
+  linear fade in level looks linear to the eye. The intensity register is only
+  written when the step actually changes.
+*/
+
+#ifndef SoyuzBrightness_h
+#define SoyuzBrightness_h
+#include "Arduino.h"
+#include "SoyuzDisplay.h"
+
+class SoyuzBrightness
+{
+public:
+  SoyuzBrightness(SoyuzDisplay &output);
+  void setTarget(uint8_t level, uint16_t fadeMs); // fade from the current level
+  void update();                                  // steps the fade, call with the display locked
+  bool busy() const { return level != target; }
+  uint8_t currentLevel() const { return level; }
+  uint8_t targetLevel() const { return target; }
+
+private:
+  static uint8_t toIntensity(uint8_t value);
+
+  SoyuzDisplay &display;
+  uint8_t level;
+  uint8_t start;
+  uint8_t target;
+  uint16_t fadeMs;
+  unsigned long fadeStart;
+};
+
+#endif
@@ -3,56 +3,84 @@
 
 #include "Arduino.h"
 #include "SoyuzDisplay.h"
+#include "SoyuzAnimator.h"
 #include "LedControl.h"
 
 SoyuzDisplay::SoyuzDisplay(int dataPin, int clockPin, int loadPin)
-    : lc(dataPin, clockPin, loadPin, 2)
+    : lc(dataPin, clockPin, loadPin, 2), intensity(15), powerOn(true), frame(), shown(), version(0), animator(NULL)
 {
     lc.shutdown(0, false);
     lc.shutdown(1, false);
     lc.setIntensity(0, 15);
     lc.setIntensity(1, 15);
-    // lc.clearDisplay(0);
+    // LedControl clears both chips on construction, so shown starts out all blank
     lc.setScanLimit(0, 4); // 5 displays per max
     lc.setScanLimit(1, 4); // 5 displays per max
 }
 
+void SoyuzDisplay::attachAnimator(SoyuzAnimator *anim)
+{
+    animator = anim;
+}
+
+// every write ends up here. the frame buffer holds what the display should
+// show, the animator (if any) gets to transition towards it
+void SoyuzDisplay::writeSegments(int position, uint8_t segments)
+{
+    if (position < 0 || position > 9 || frame[position] == segments)
+        return;
+    frame[position] = segments;
+    version++;
+    if (animator && animator->start(position, shown[position], segments))
+        return;
+    writeRaw(position, segments);
+}
+
+// straight to the chip, skipped when the digit already shows this
+void SoyuzDisplay::writeRaw(int position, uint8_t segments)
+{
+    if (shown[position] == segments)
+        return;
+    shown[position] = segments;
+    lc.setRow(position > 4 ? 1 : 0, position > 4 ? position - 5 : position, segments);
+}
+
+void SoyuzDisplay::writeDigit(int position, int number, bool dot)
+{
+    if (number < 0 || number > 15) // LedControl ignored these too
+        return;
+    writeSegments(position, myCharTable[number] | (dot ? B10000000 : 0));
+}
+
 void SoyuzDisplay::writeValueToDisplay(int number[], bool dot[])
 {
     for (int i = 0; i < 10; i++)
     {
-        lc.setDigit((i > 4 ? 1 : 0), (i > 4 ? i - 5 : i), number[i], dot[i]);
+        writeDigit(i, number[i], dot[i]);
     }
 }
 
 void SoyuzDisplay::writeValueToDisplay(int number, int position, bool dot)
 {
-    if (position > 4)
-    {
-        lc.setDigit(1, position - 5, number, dot);
-    }
-    else
-    {
-        lc.setDigit(0, position, number, dot);
-    }
+    writeDigit(position, number, dot);
 }
 
 void SoyuzDisplay::writeTimeToDisplay(int hour, int minute, int second, byte dotsMask)
 {
-    lc.setDigit(0, 0, second % 10, dotsMask & 1);
-    lc.setDigit(0, 1, second / 10, dotsMask >> 1 & 1);
-    lc.setDigit(0, 2, minute % 10, dotsMask >> 2 & 1);
-    lc.setDigit(0, 3, minute / 10, dotsMask >> 3 & 1);
-    lc.setDigit(0, 4, hour % 10, dotsMask >> 4 & 1);
-    lc.setDigit(1, 0, hour / 10, dotsMask >> 5 & 1);
+    writeDigit(0, second % 10, dotsMask & 1);
+    writeDigit(1, second / 10, dotsMask >> 1 & 1);
+    writeDigit(2, minute % 10, dotsMask >> 2 & 1);
+    writeDigit(3, minute / 10, dotsMask >> 3 & 1);
+    writeDigit(4, hour % 10, dotsMask >> 4 & 1);
+    writeDigit(5, hour / 10, dotsMask >> 5 & 1);
 }
 
 void SoyuzDisplay::writeTimeToSmallDisplay(int minute, int second, byte dotsMask)
 {
-    lc.setDigit(1, 1, second % 10, dotsMask & 1);
-    lc.setDigit(1, 2, second / 10, dotsMask >> 1 & 1);
-    lc.setDigit(1, 3, minute % 10, dotsMask >> 2 & 1);
-    lc.setDigit(1, 4, minute / 10, dotsMask >> 3 & 1);
+    writeDigit(6, second % 10, dotsMask & 1);
+    writeDigit(7, second / 10, dotsMask >> 1 & 1);
+    writeDigit(8, minute % 10, dotsMask >> 2 & 1);
+    writeDigit(9, minute / 10, dotsMask >> 3 & 1);
 }
 
 void SoyuzDisplay::writeChar(char val, int position, bool dot)
@@ -60,22 +88,20 @@ void SoyuzDisplay::writeChar(char val, int position, bool dot)
     if (val > 127)
         val = 32;
     byte value = myCharTable[val] | (dot ? B10000000 : 0);
-    if (position > 4)
-    {
-        lc.setRow(1, position - 5, value);
-    }
-    else
-    {
-        lc.setRow(0, position, value);
-    }
+    writeSegments(position, value);
+}
+
+void SoyuzDisplay::writeStringToDisplay(const char *s) //  only displays first 10 chars. overflows to stop watch
+{
+    writeStringToDisplay(s, strnlen(s, 10));
 }
 
-void SoyuzDisplay::writeStringToDisplay(String s) //  only displays first 10 chars. overflows to stop watch
+void SoyuzDisplay::writeStringToDisplay(const char *s, size_t len)
 {
-    for (int i = 0; i < s.length(); i++)
+    if (len > 10)
+        len = 10;
+    for (size_t i = 0; i < len; i++)
     {
-        if (i > 9)
-            return;
         writeChar(s[i], i, 0);
     }
 }
@@ -83,7 +109,7 @@ void SoyuzDisplay::writeSoyuz()
 {
     writeChar('C', 5, 0);
     writeChar('o', 4, 0);
-    lc.setRow(0, 3, B00000111); // half of yu character
+    writeSegments(3, B00000111); // half of yu character
     writeChar('0', 2, 0);
     writeChar('3', 1, 0);
     writeChar(' ', 0, 0);
@@ -91,14 +117,32 @@ void SoyuzDisplay::writeSoyuz()
 
 void SoyuzDisplay::blankTimeDisplay()
 {
-    lc.clearDisplay(0);
-    lc.setChar(1, 0, ' ', false);
+    for (int i = 0; i < 6; i++)
+        writeSegments(i, 0);
 }
 
 void SoyuzDisplay::blankSmallDisplay()
 {
-    lc.setChar(1, 1, ' ', false);
-    lc.setChar(1, 2, ' ', false);
-    lc.setChar(1, 3, ' ', false);
-    lc.setChar(1, 4, ' ', false);
+    for (int i = 6; i < 10; i++)
+        writeSegments(i, 0);
+}
+
+void SoyuzDisplay::setIntensity(uint8_t level)
+{
+    if (level > 15)
+        level = 15;
+    if (level == intensity)
+        return;
+    intensity = level;
+    lc.setIntensity(0, level);
+    lc.setIntensity(1, level);
+}
+
+void SoyuzDisplay::setPower(bool on)
+{
+    if (on == powerOn)
+        return;
+    powerOn = on;
+    lc.shutdown(0, !on);
+    lc.shutdown(1, !on);
 }
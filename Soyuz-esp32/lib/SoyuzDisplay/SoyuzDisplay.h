@@ -6,6 +6,8 @@
 #include "Arduino.h"
 #include "LedControl.h"
 
+class SoyuzAnimator;
+
 class SoyuzDisplay
 {
 public:
@@ -15,13 +17,29 @@ public:
   void writeTimeToDisplay(int hour, int minute, int second, byte dotsMask);
   void writeTimeToSmallDisplay(int minute, int second, byte dotsMask);
   void writeChar(char val, int position, bool dot);
-  void writeStringToDisplay(String s);
+  void writeStringToDisplay(const char *s);
+  void writeStringToDisplay(const char *s, size_t len);
   void writeSoyuz();  // print soyuz in cyrillic
   void blankTimeDisplay();
   void blankSmallDisplay();
+  void setIntensity(uint8_t level); // 0-15, only written to the MAX7219s when it changes
+  void setPower(bool on);           // shutdown mode when off, only written when it changes
+  void writeSegments(int position, uint8_t segments); // raw segment byte, bit 7 is the dot
+  void writeRaw(int position, uint8_t segments);      // bypasses the animator
+  void attachAnimator(SoyuzAnimator *anim);
+  const uint8_t *frameBuffer() const { return frame; } // 10 segment bytes, position 0 first. read under the lock writers hold
+  uint32_t frameVersion() const { return version; }     // bumps whenever the frame buffer changes
 
 private:
   LedControl lc;
+  void writeDigit(int position, int number, bool dot);
+
+  uint8_t intensity;
+  bool powerOn;
+  uint8_t frame[10]; // what the display should show
+  uint8_t shown[10]; // what the chips are showing
+  volatile uint32_t version;
+  SoyuzAnimator *animator;
   const uint8_t myCharTable[128] = {
       B01111110, B00110000, B01101101, B01111001, B00110011, B01011011, B01011111, B01110000,
       B01111111, B01111011, B01110111, B00011111, B00001101, B00111101, B01001111, B01000111,
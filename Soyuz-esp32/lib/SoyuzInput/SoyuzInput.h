@@ -0,0 +1,63 @@
+/*
+  Batched input sampling for switches and buttons on GPIO 32-39. All of those
+  pins live in the GPIO.in1 bank, so one register load samples every input and
+  one XOR against the previous snapshot finds what changed. The pin list is a
+  template parameter, so masks and bit positions are folded at compile time.
+*/
+
+#ifndef SoyuzInput_h
+#define SoyuzInput_h
+#include "Arduino.h"
+#include "soc/gpio_struct.h"
+
+template <uint8_t... Pins>
+struct InputPinMask;
+
+template <>
+struct InputPinMask<>
+{
+  static constexpr uint32_t value = 0;
+};
+
+template <uint8_t Pin, uint8_t... Rest>
+struct InputPinMask<Pin, Rest...>
+{
+  static_assert(Pin >= 32 && Pin <= 39, "input pins must be in GPIO bank 1 (32-39)");
+  static constexpr uint32_t value = (1UL << (Pin - 32)) | InputPinMask<Rest...>::value;
+};
+
+template <uint8_t... Pins>
+class InputBank
+{
+public:
+  static constexpr uint32_t mask = InputPinMask<Pins...>::value;
+
+  static constexpr uint32_t bit(uint8_t pin) { return 1UL << (pin - 32); }
+
+  // read every input at once, returns the mask of inputs that changed since the last
+  // sample(). edges are against what sample() last saw, so each is reported exactly once
+  uint32_t sample()
+  {
+    current = GPIO.in1.val & mask;
+    changes = sampled ^ current;
+    sampled = current;
+    return changes;
+  }
+
+  // fresh levels for a nested poll loop (setTime), leaves the edges sample() reports alone
+  void refresh() { current = GPIO.in1.val & mask; }
+
+  bool isHigh(uint8_t pin) const { return current & bit(pin); }
+  bool isLow(uint8_t pin) const { return !(current & bit(pin)); }
+  bool changed(uint8_t pin) const { return changes & bit(pin); }
+  bool fell(uint8_t pin) const { return changes & ~current & bit(pin); }
+  bool rose(uint8_t pin) const { return changes & current & bit(pin); }
+  uint32_t snapshot() const { return current; }
+
+private:
+  uint32_t current = 0;
+  uint32_t sampled = 0; // levels at the last sample()
+  uint32_t changes = 0;
+};
+
+#endif
@@ -0,0 +1,101 @@
+/*
+*/
+
+#include "Arduino.h"
+#include "SoyuzLog.h"
+
+SoyuzLog::Record SoyuzLog::ring[SoyuzLog::ringSize];
+std::atomic<uint32_t> SoyuzLog::head(0);
+uint32_t SoyuzLog::tail = 0;
+std::atomic<uint32_t> SoyuzLog::dropped(0);
+
+static const char levelChars[] = {' ', 'E', 'W', 'I', 'D'};
+
+void SoyuzLog::begin(const TaskConfig &config)
+{
+    startTask(drainTask, config);
+}
+
+uint32_t SoyuzLog::droppedCount()
+{
+    return dropped.load(std::memory_order_relaxed);
+}
+
+// bounded multi producer queue. a slot is free for position pos when its
+// sequence equals pos, and holds a record once it equals pos + 1
+void SoyuzLog::push(uint8_t level, uint8_t category, const char *fmt, const int32_t *args)
+{
+    uint32_t pos = head.load(std::memory_order_relaxed);
+    Record *slot;
+    uint32_t index;
+    while (1)
+    {
+        index = pos & (ringSize - 1);
+        slot = &ring[index];
+        uint32_t sequence = slot->sequence.load(std::memory_order_acquire) + index;
+        int32_t diff = (int32_t)(sequence - pos);
+        if (diff == 0)
+        {
+            if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0) // ring full, never wait for the drain task
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+    slot->entry.fmt = fmt;
+    slot->entry.timestamp = millis();
+    slot->entry.level = level;
+    slot->entry.category = category;
+    for (int i = 0; i < maxArgs; i++)
+        slot->entry.args[i] = args[i];
+    slot->sequence.store(pos + 1 - index, std::memory_order_release);
+}
+
+bool SoyuzLog::pop(Entry &out)
+{
+    uint32_t index = tail & (ringSize - 1);
+    Record &slot = ring[index];
+    uint32_t sequence = slot.sequence.load(std::memory_order_acquire) + index;
+    if ((int32_t)(sequence - (tail + 1)) < 0)
+        return false; // empty, or the producer has not finished writing
+    out = slot.entry;
+    slot.sequence.store(tail + ringSize - index, std::memory_order_release);
+    tail++;
+    return true;
+}
+
+void SoyuzLog::drainTask(void *parameter)
+{
+    char line[128];
+    Entry entry;
+    uint32_t lastDropped = 0;
+    while (1)
+    {
+        while (pop(entry))
+        {
+            int n = snprintf(line, sizeof(line), "[%lu %c] ", (unsigned long)entry.timestamp,
+                             levelChars[entry.level < sizeof(levelChars) ? entry.level : 0]);
+            // unused trailing args are ignored by the formatter
+            n += snprintf(line + n, sizeof(line) - n, entry.fmt, entry.args[0], entry.args[1],
+                          entry.args[2], entry.args[3], entry.args[4], entry.args[5]);
+            if (n > (int)sizeof(line) - 2)
+                n = sizeof(line) - 2;
+            line[n++] = '\n';
+            Serial.write((const uint8_t *)line, n);
+        }
+        uint32_t droppedNow = droppedCount();
+        if (droppedNow != lastDropped)
+        {
+            Serial.printf("[log] %lu records dropped\n", (unsigned long)(droppedNow - lastDropped));
+            lastDropped = droppedNow;
+        }
+        delay(20);
+    }
+}
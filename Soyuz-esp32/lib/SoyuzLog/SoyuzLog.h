@@ -0,0 +1,127 @@
+/*
+  Asynchronous logger. Call sites push a small binary record (format string
+  pointer + up to 6 integer args) into a lock-free ring, and a low priority
+  task formats and drains it to Serial. Callers never block; if the ring is
+  full the record is dropped and counted.
+
+  Levels and categories not enabled by SOYUZ_LOG_LEVEL / SOYUZ_LOG_CATEGORIES
+  are removed at compile time, format strings included.
+*/
+
+#ifndef SoyuzLog_h
+#define SoyuzLog_h
+#include "Arduino.h"
+#include "TaskConfig.h"
+#include <atomic>
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#define LOG_CAT_SYS (1 << 0)
+#define LOG_CAT_CLOCK (1 << 1)
+#define LOG_CAT_DISPLAY (1 << 2)
+#define LOG_CAT_INPUT (1 << 3)
+#define LOG_CAT_NET (1 << 4)
+#define LOG_CAT_AUDIO (1 << 5)
+#define LOG_CAT_ALL 0xFF
+
+#ifndef SOYUZ_LOG_LEVEL
+#define SOYUZ_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#ifndef SOYUZ_LOG_CATEGORIES
+#define SOYUZ_LOG_CATEGORIES LOG_CAT_ALL
+#endif
+
+// fmt must be a string literal, args must be integers (no %s, %f). a disabled
+// category picks the empty LogWriter<false>, so nothing of the call is emitted
+#define SOYUZ_LOG(level, cat, fmt, ...) \
+    LogWriter<((cat) & SOYUZ_LOG_CATEGORIES) != 0>::write((level), (cat), fmt, ##__VA_ARGS__)
+
+// disabled levels are removed by the preprocessor, args and all
+#define SOYUZ_LOG_NOTHING() \
+    do                      \
+    {                       \
+    } while (0)
+
+#if SOYUZ_LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(cat, fmt, ...) SOYUZ_LOG(LOG_LEVEL_ERROR, cat, fmt, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(cat, fmt, ...) SOYUZ_LOG_NOTHING()
+#endif
+#if SOYUZ_LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(cat, fmt, ...) SOYUZ_LOG(LOG_LEVEL_WARN, cat, fmt, ##__VA_ARGS__)
+#else
+#define LOG_WARN(cat, fmt, ...) SOYUZ_LOG_NOTHING()
+#endif
+#if SOYUZ_LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(cat, fmt, ...) SOYUZ_LOG(LOG_LEVEL_INFO, cat, fmt, ##__VA_ARGS__)
+#else
+#define LOG_INFO(cat, fmt, ...) SOYUZ_LOG_NOTHING()
+#endif
+#if SOYUZ_LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(cat, fmt, ...) SOYUZ_LOG(LOG_LEVEL_DEBUG, cat, fmt, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(cat, fmt, ...) SOYUZ_LOG_NOTHING()
+#endif
+
+class SoyuzLog
+{
+public:
+  static const int maxArgs = 6;
+  static const uint32_t ringSize = 64; // must be a power of 2
+
+  static void begin(const TaskConfig &config); // starts the drain task
+  static uint32_t droppedCount();
+  static void push(uint8_t level, uint8_t category, const char *fmt, const int32_t *args);
+
+private:
+  struct Entry
+  {
+    const char *fmt;
+    uint32_t timestamp;
+    int32_t args[maxArgs];
+    uint8_t level;
+    uint8_t category;
+  };
+  struct Record
+  {
+    std::atomic<uint32_t> sequence; // stored relative to the slot index, so zero init is valid
+    Entry entry;
+  };
+
+  static bool pop(Entry &out);
+  static void drainTask(void *parameter);
+
+  static Record ring[ringSize];
+  static std::atomic<uint32_t> head; // next slot to reserve (producers)
+  static uint32_t tail;              // next slot to drain (single consumer)
+  static std::atomic<uint32_t> dropped;
+};
+
+template <bool enabled>
+struct LogWriter
+{
+  template <typename... Args>
+  static void write(uint8_t level, uint8_t category, const char *fmt, Args... args)
+  {
+    static_assert(sizeof...(Args) <= SoyuzLog::maxArgs, "too many log arguments");
+    const int32_t argv[SoyuzLog::maxArgs] = {static_cast<int32_t>(args)...};
+    SoyuzLog::push(level, category, fmt, argv);
+  }
+};
+
+template <>
+struct LogWriter<false>
+{
+  template <typename... Args>
+  static void write(uint8_t, uint8_t, const char *, Args...)
+  {
+    static_assert(sizeof...(Args) <= SoyuzLog::maxArgs, "too many log arguments");
+  }
+};
+
+#endif
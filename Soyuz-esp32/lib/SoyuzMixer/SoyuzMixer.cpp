@@ -0,0 +1,156 @@
+/*
+*/
+
+#include "Arduino.h"
+#include "SoyuzMixer.h"
+#include "SoyuzLog.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+int SynthSource::pull(int16_t *dest, int frames)
+{
+    if (!synth.active())
+        return 0;
+    synth.render(dest, frames);
+    return frames;
+}
+
+void PcmSource::play(const int16_t *samples, size_t frames)
+{
+    requestedFrames = frames;
+    requested = samples;
+}
+
+int PcmSource::pull(int16_t *dest, int frames)
+{
+    const int16_t *samples = requested;
+    if (samples) // picked up on the mixer's side so a restart never tears a block
+    {
+        requested = NULL;
+        pcm = samples;
+        length = requestedFrames;
+        pos = 0;
+    }
+    if (!pcm)
+        return 0;
+    size_t n = min((size_t)frames, length - pos);
+    memcpy(dest, pcm + pos * 2, n * 4);
+    pos += n;
+    if (pos >= length)
+        pcm = NULL;
+    return n;
+}
+
+StreamSource::StreamSource(size_t ringBytes)
+    : size(ringBytes), ring(NULL), head(0), tail(0), finished(true)
+{
+}
+
+bool StreamSource::begin()
+{
+    ring = (uint8_t *)heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!ring)
+        ring = (uint8_t *)heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    return ring != NULL;
+}
+
+size_t StreamSource::space() const
+{
+    return size - used();
+}
+
+// single producer, the caller checks space() first. anything that doesn't fit is dropped
+size_t StreamSource::write(const uint8_t *data, size_t len)
+{
+    if (!ring)
+        return 0;
+    len = min(len, space());
+    size_t start = head.load(std::memory_order_relaxed) % size;
+    size_t first = min(len, size - start);
+    memcpy(ring + start, data, first);
+    memcpy(ring, data + first, len - first);
+    head.fetch_add(len, std::memory_order_release);
+    return len;
+}
+
+int StreamSource::pull(int16_t *dest, int frames)
+{
+    size_t len = min((size_t)frames * 4, used() & ~(size_t)3); // whole stereo frames only
+    size_t start = tail.load(std::memory_order_relaxed) % size;
+    size_t first = min(len, size - start);
+    memcpy(dest, ring + start, first);
+    memcpy((uint8_t *)dest + first, ring, len - first);
+    tail.fetch_add(len, std::memory_order_release);
+    return len / 4;
+}
+
+SoyuzMixer::SoyuzMixer() : voices(), voiceCount(0), blockStats(1000)
+{
+}
+
+int SoyuzMixer::addVoice(MixerSource *source, uint16_t gain)
+{
+    if (voiceCount >= maxVoices)
+        return -1;
+    voices[voiceCount].source = source;
+    voices[voiceCount].gain = gain;
+    voices[voiceCount].underruns = 0;
+    return voiceCount++;
+}
+
+void SoyuzMixer::setGain(int voice, uint16_t gain)
+{
+    if (voice >= 0 && voice < voiceCount)
+        voices[voice].gain = gain;
+}
+
+bool SoyuzMixer::active()
+{
+    for (int v = 0; v < voiceCount; v++)
+    {
+        if (voices[v].source->active())
+            return true;
+    }
+    return false;
+}
+
+void SoyuzMixer::mix(int16_t *out)
+{
+    uint32_t start = esp_timer_get_time();
+    memset(accumulator, 0, sizeof(accumulator));
+    for (int v = 0; v < voiceCount; v++)
+    {
+        Voice &voice = voices[v];
+        if (!voice.source->active())
+            continue;
+        int frames = voice.source->pull(scratch, blockFrames);
+        if (frames < blockFrames && voice.source->active())
+            voice.underruns++; // still playing but couldn't fill the block
+        int32_t gain = voice.gain;
+        for (int i = 0; i < frames * 2; i++)
+            accumulator[i] += (scratch[i] * gain) >> 8;
+    }
+    for (int i = 0; i < blockFrames * 2; i++)
+    {
+        int32_t s = accumulator[i];
+        if (s > 32767)
+            s = 32767;
+        else if (s < -32768)
+            s = -32768;
+        out[i] = s;
+    }
+    blockStats.record((uint32_t)esp_timer_get_time() - start);
+}
+
+void SoyuzMixer::report()
+{
+    for (int v = 0; v < voiceCount; v++)
+    {
+        if (voices[v].underruns)
+            LOG_WARN(LOG_CAT_AUDIO, "mixer voice %d: %u underruns", v, voices[v].underruns);
+        voices[v].underruns = 0;
+    }
+    LOG_INFO(LOG_CAT_AUDIO, "mixer %u blocks, us per block avg %u max %u over %u", blockStats.count(),
+             blockStats.avg(), blockStats.max(), blockStats.overBudget());
+    blockStats.reset();
+}
@@ -0,0 +1,108 @@
+/*
+  Multi-voice mixer in front of I2S. Each voice is a MixerSource that fills
+  a block of interleaved 16 bit stereo at 44.1kHz; the mixer sums the voices
+  with per-voice gain in 32 bit and saturates back to 16 bit. Sources are
+  called once per block, never per sample.
+
+  Blocks are 128 frames (2.9ms) so a new sound is at most one block plus the
+  I2S DMA queue away from the speaker. The audio task sizes each DMA buffer
+  to one block, and it logs the measured request to DMA time.
+*/
+
+#ifndef SoyuzMixer_h
+#define SoyuzMixer_h
+#include "Arduino.h"
+#include "SoyuzSynth.h"
+#include "SoyuzTiming.h"
+#include <atomic>
+
+class MixerSource
+{
+public:
+  virtual bool active() = 0;
+  virtual int pull(int16_t *dest, int frames) = 0; // frames actually produced
+};
+
+// synthesized tones
+class SynthSource : public MixerSource
+{
+public:
+  SynthSource(SoyuzSynth &source) : synth(source) {}
+  bool active() override { return synth.active(); }
+  int pull(int16_t *dest, int frames) override;
+
+private:
+  SoyuzSynth &synth;
+};
+
+// a sound already decoded into RAM. play() is thread safe and restarts it
+class PcmSource : public MixerSource
+{
+public:
+  void play(const int16_t *samples, size_t frames);
+  bool active() override { return requested || pcm; }
+  int pull(int16_t *dest, int frames) override;
+
+private:
+  const int16_t *volatile requested = NULL;
+  volatile size_t requestedFrames = 0;
+  const int16_t *pcm = NULL;
+  size_t length = 0;
+  size_t pos = 0;
+};
+
+// streamed audio, e.g. the MP3 decoder's output. the producer writes into a
+// ring through the Print interface and the mixer drains it. one producer and
+// one consumer, which may be on different tasks
+class StreamSource : public MixerSource, public Print
+{
+public:
+  StreamSource(size_t ringBytes);
+  bool begin();
+  size_t space() const;
+  void finish() { finished = true; } // producer is done, voice ends when the ring is empty
+  void restart() { finished = false; }
+  bool active() override { return !finished || used() > 0; }
+  int pull(int16_t *dest, int frames) override;
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t *data, size_t len) override;
+
+private:
+  size_t used() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+
+  size_t size;
+  uint8_t *ring;
+  std::atomic<size_t> head; // total bytes written
+  std::atomic<size_t> tail; // total bytes read
+  volatile bool finished;
+};
+
+class SoyuzMixer
+{
+public:
+  static const int maxVoices = 4;
+  static const int blockFrames = SoyuzSynth::blockFrames;
+
+  SoyuzMixer();
+  int addVoice(MixerSource *source, uint16_t gain = 256); // gain Q8, 256 = unity. returns the voice index
+  void setGain(int voice, uint16_t gain);
+  bool active();
+  void mix(int16_t *out); // one block of blockFrames stereo frames
+  void report();          // logs and clears underruns and block timing
+
+private:
+  struct Voice
+  {
+    MixerSource *source;
+    uint16_t gain;
+    uint32_t underruns;
+  };
+
+  Voice voices[maxVoices];
+  int voiceCount;
+  int16_t scratch[blockFrames * 2];
+  int32_t accumulator[blockFrames * 2];
+  LatencyStats blockStats;
+};
+
+#endif
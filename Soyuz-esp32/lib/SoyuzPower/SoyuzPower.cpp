@@ -0,0 +1,112 @@
+/*
+*/
+
+#include "Arduino.h"
+#include "SoyuzPower.h"
+#include "SoyuzLog.h"
+#include "driver/gpio.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "esp_idf_version.h"
+
+PowerLock::PowerLock(const char *name, esp_pm_lock_type_t lockType)
+    : lockName(name), type(lockType), handle(NULL), depth(0), acquiredAt(0), totalHeldUs(0)
+{
+    portMUX_INITIALIZE(&mux);
+}
+
+void PowerLock::begin()
+{
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_create(type, 0, lockName, &handle);
+#endif
+}
+
+// the PM driver counts nested acquires itself, depth only tracks held time
+void PowerLock::acquire()
+{
+    if (handle)
+        esp_pm_lock_acquire(handle);
+    portENTER_CRITICAL(&mux);
+    if (depth++ == 0)
+        acquiredAt = esp_timer_get_time();
+    portEXIT_CRITICAL(&mux);
+}
+
+void PowerLock::release()
+{
+    portENTER_CRITICAL(&mux);
+    if (depth == 0)
+    {
+        portEXIT_CRITICAL(&mux);
+        return;
+    }
+    if (--depth == 0)
+        totalHeldUs += esp_timer_get_time() - acquiredAt;
+    portEXIT_CRITICAL(&mux);
+    if (handle)
+        esp_pm_lock_release(handle);
+}
+
+uint32_t PowerLock::heldMs()
+{
+    portENTER_CRITICAL(&mux);
+    uint64_t us = totalHeldUs;
+    if (depth > 0)
+        us += esp_timer_get_time() - acquiredAt;
+    portEXIT_CRITICAL(&mux);
+    return us / 1000;
+}
+
+bool SoyuzPower::begin(int maxMhz, int minMhz, bool lightSleep)
+{
+#if CONFIG_PM_ENABLE
+#if ESP_IDF_VERSION_MAJOR >= 5
+    esp_pm_config_t config;
+#else
+    esp_pm_config_esp32_t config;
+#endif
+    config.max_freq_mhz = maxMhz;
+    config.min_freq_mhz = minMhz;
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+    config.light_sleep_enable = lightSleep;
+#else
+    config.light_sleep_enable = false;
+    if (lightSleep)
+        LOG_WARN(LOG_CAT_SYS, "light sleep needs CONFIG_FREERTOS_USE_TICKLESS_IDLE, DFS only");
+#endif
+    esp_err_t err = esp_pm_configure(&config);
+    if (err != ESP_OK)
+    {
+        LOG_ERROR(LOG_CAT_SYS, "esp_pm_configure failed %d", err);
+        return false;
+    }
+    return true;
+#else
+    // no PM in this build, so no lock could raise the clock for the work that needs it
+    setCpuFrequencyMhz(maxMhz);
+    LOG_WARN(LOG_CAT_SYS, "no CONFIG_PM_ENABLE, fixed %d MHz. the esp-wrover-kit-power env has PM", maxMhz);
+    return false;
+#endif
+}
+
+void SoyuzPower::enableButtonWakeup(uint8_t pin)
+{
+    gpio_wakeup_enable((gpio_num_t)pin, GPIO_INTR_LOW_LEVEL);
+    esp_sleep_enable_gpio_wakeup();
+}
+
+void SoyuzPower::report(PowerLock *locks[], int count)
+{
+    uint32_t uptimeMs = esp_timer_get_time() / 1000;
+    for (int i = 0; i < count; i++)
+    {
+        uint32_t held = locks[i]->heldMs();
+        LOG_INFO(LOG_CAT_SYS, "power: lock %d at max freq %u ms of %u ms", i, held, uptimeMs);
+    }
+#if CONFIG_PM_PROFILING
+    esp_pm_dump_locks(stdout); // time spent in each power mode, straight from the PM driver
+#else
+    LOG_INFO(LOG_CAT_SYS, "power: lock hold times only, time per power mode needs CONFIG_PM_PROFILING");
+#endif
+}
@@ -0,0 +1,58 @@
+/*
+  Power management on top of the ESP-IDF PM locks. SoyuzPower::begin turns on
+  dynamic frequency scaling and automatic light sleep, and code that needs the
+  full clock speed holds a PowerLock only while it works. Each lock keeps how
+  long it has been held so report() can show where the time goes. That is
+  lock hold time, not time per power mode. The PM driver only keeps that with
+  CONFIG_PM_PROFILING, and then report() dumps it too.
+
+  Needs CONFIG_PM_ENABLE (and CONFIG_FREERTOS_USE_TICKLESS_IDLE for light
+  sleep, begin() warns when that is missing). The esp-wrover-kit-power env in
+  platformio.ini builds with all three. Without PM begin() runs the CPU at the
+  maximum frequency, warns, and locks do nothing but count.
+*/
+
+#ifndef SoyuzPower_h
+#define SoyuzPower_h
+#include "Arduino.h"
+#include "esp_pm.h"
+
+class PowerLock
+{
+public:
+  PowerLock(const char *name, esp_pm_lock_type_t type = ESP_PM_CPU_FREQ_MAX);
+  void begin();
+  void acquire();
+  void release();
+  const char *name() const { return lockName; }
+  uint32_t heldMs();
+
+private:
+  const char *lockName;
+  esp_pm_lock_type_t type;
+  esp_pm_lock_handle_t handle;
+  portMUX_TYPE mux; // acquired from several tasks
+  uint32_t depth;
+  int64_t acquiredAt;
+  uint64_t totalHeldUs;
+};
+
+class PowerGuard // holds a lock for the current scope
+{
+public:
+  PowerGuard(PowerLock &held) : lock(held) { lock.acquire(); }
+  ~PowerGuard() { lock.release(); }
+
+private:
+  PowerLock &lock;
+};
+
+class SoyuzPower
+{
+public:
+  static bool begin(int maxMhz, int minMhz, bool lightSleep);
+  static void enableButtonWakeup(uint8_t pin); // wake from light sleep while pin is low
+  static void report(PowerLock *locks[], int count); // logs each lock by its index in locks
+};
+
+#endif
@@ -0,0 +1,93 @@
+/*
+*/
+
+#include "Arduino.h"
+#include "SoyuzSequence.h"
+#include "esp_timer.h"
+
+SoyuzSequence::SoyuzSequence(SoyuzDisplay &output)
+    : display(output), in(NULL), bufferPos(0), bufferLen(0), frameCount(0), frameDuration(0),
+      frameStart(0), playing(false), frames(0), bytes(0), readTimeUs(0)
+{
+}
+
+bool SoyuzSequence::begin(Stream &input)
+{
+    in = &input;
+    bufferPos = bufferLen = 0;
+    frames = bytes = readTimeUs = 0;
+    playing = false;
+
+    uint8_t header[8];
+    for (int i = 0; i < 8; i++)
+    {
+        int c = readByte();
+        if (c < 0)
+            return false;
+        header[i] = c;
+    }
+    if (memcmp(header, "SOYQ", 4) != 0 || header[4] != 1)
+        return false;
+    frameCount = header[6] | header[7] << 8;
+    playing = readFrame();
+    return playing;
+}
+
+bool SoyuzSequence::update()
+{
+    if (!playing)
+        return false;
+    if (millis() - frameStart < frameDuration)
+        return true;
+    playing = (frameCount == 0 || frames < frameCount) && readFrame();
+    return playing;
+}
+
+void SoyuzSequence::play()
+{
+    while (update())
+    {
+        delay(1);
+    }
+}
+
+int SoyuzSequence::readByte()
+{
+    if (bufferPos == bufferLen)
+    {
+        uint32_t start = esp_timer_get_time();
+        bufferLen = in->readBytes(buffer, readAheadSize);
+        readTimeUs += (uint32_t)esp_timer_get_time() - start;
+        bufferPos = 0;
+        bytes += bufferLen;
+        if (bufferLen == 0)
+            return -1;
+    }
+    return buffer[bufferPos++];
+}
+
+// decodes the next frame straight onto the display, unchanged positions are left alone
+bool SoyuzSequence::readFrame()
+{
+    int b[4];
+    for (int i = 0; i < 4; i++)
+    {
+        b[i] = readByte();
+        if (b[i] < 0)
+            return false;
+    }
+    frameDuration = b[0] | b[1] << 8;
+    uint16_t mask = b[2] | b[3] << 8;
+    for (int i = 0; i < 10; i++)
+    {
+        if (!(mask & (1 << i)))
+            continue;
+        int c = readByte();
+        if (c < 0)
+            return false;
+        display.writeSegments(i, c);
+    }
+    frameStart = millis();
+    frames++;
+    return true;
+}
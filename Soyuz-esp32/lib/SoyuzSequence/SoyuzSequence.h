@@ -0,0 +1,49 @@
+/*
+  Player for display sequences streamed off the SD card (tools/soyuzseq.py
+  writes them). Only a small read-ahead buffer is held in RAM.
+
+  Format, little endian:
+    header  "SOYQ", u8 version (1), u8 reserved, u16 frame count (0 = until end of file)
+    frame   u16 duration ms, u16 change mask (bit n = position n), then one
+            segment byte per set bit, lowest position first. Positions not in
+            the mask keep the previous frame's segments, the first frame is
+            relative to a blank display.
+*/
+
+#ifndef SoyuzSequence_h
+#define SoyuzSequence_h
+#include "Arduino.h"
+#include "SoyuzDisplay.h"
+
+class SoyuzSequence
+{
+public:
+  SoyuzSequence(SoyuzDisplay &output);
+  bool begin(Stream &input);  // false if the header is bad
+  bool update();              // shows the next frame when the current one is done. false once finished
+  void play();                // blocking, for boot
+  uint32_t framesPlayed() const { return frames; }
+  uint32_t bytesRead() const { return bytes; }
+  uint32_t readUs() const { return readTimeUs; } // in the file reads only, not the display writes
+
+private:
+  static const size_t readAheadSize = 128;
+
+  int readByte();
+  bool readFrame();
+
+  SoyuzDisplay &display;
+  Stream *in;
+  uint8_t buffer[readAheadSize];
+  size_t bufferPos;
+  size_t bufferLen;
+  uint16_t frameCount;
+  uint16_t frameDuration;
+  unsigned long frameStart;
+  bool playing;
+  uint32_t frames;
+  uint32_t bytes;
+  uint32_t readTimeUs;
+};
+
+#endif
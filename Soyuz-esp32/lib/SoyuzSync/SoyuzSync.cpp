@@ -0,0 +1,251 @@
+/*
+*/
+
+#include "Arduino.h"
+#include "SoyuzSync.h"
+#include "SoyuzLog.h"
+#include "lwip/sockets.h"
+#include <sys/time.h>
+
+#define SYNC_GROUP "239.255.83.89"
+#define SYNC_VERSION 2
+
+static int64_t timevalUs(const struct timeval &tv)
+{
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int64_t nowUs()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return timevalUs(tv);
+}
+
+// true while the last adjtime is still being worked off
+static bool slewing()
+{
+    struct timeval left = {0, 0};
+    adjtime(NULL, &left);
+    return left.tv_sec != 0 || left.tv_usec != 0;
+}
+
+SoyuzSync::Stamp SoyuzSync::toStamp(int64_t us)
+{
+    Stamp stamp = {(uint32_t)(us / 1000000), (uint32_t)(us % 1000000)};
+    return stamp;
+}
+
+int64_t SoyuzSync::fromStamp(const Stamp &stamp)
+{
+    return (int64_t)stamp.sec * 1000000 + stamp.usec;
+}
+
+SoyuzSync::SoyuzSync()
+    : role(off), beaconSock(-1), exchangeSock(-1), sequence(0), lastBeaconSec(0), pendingOrigin(0), pendingSequence(0),
+      burstLeft(0), bestDelay(INT64_MAX), bestOffset(0), samples(0), corrected(false), correctedAtMs(0), lastError(0),
+      lastDelay(0), minError(INT32_MAX), maxError(INT32_MIN), exchanges(0), steps(0), slews(0), rejected(0)
+{
+}
+
+bool SoyuzSync::begin(const TaskConfig &config)
+{
+    beaconSock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    exchangeSock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (beaconSock < 0 || exchangeSock < 0)
+    {
+        LOG_ERROR(LOG_CAT_NET, "sync sockets failed, errno %d", errno);
+        if (beaconSock >= 0)
+            close(beaconSock);
+        if (exchangeSock >= 0)
+            close(exchangeSock);
+        beaconSock = exchangeSock = -1;
+        return false;
+    }
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    struct ip_mreq group = {};
+    group.imr_multiaddr.s_addr = inet_addr(SYNC_GROUP);
+    group.imr_interface.s_addr = htonl(INADDR_ANY);
+    int reuse = 1;   // more than one clock per host, the host test runs several
+    uint8_t ttl = 1; // never leaves the LAN
+    if (setsockopt(beaconSock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0 ||
+        bind(beaconSock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        setsockopt(beaconSock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &group, sizeof(group)) < 0 ||
+        setsockopt(exchangeSock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0)
+    {
+        LOG_ERROR(LOG_CAT_NET, "sync socket setup failed, errno %d", errno);
+        close(beaconSock);
+        close(exchangeSock);
+        beaconSock = exchangeSock = -1;
+        return false;
+    }
+    return startTask(task, config, this) == pdPASS;
+}
+
+void SoyuzSync::task(void *parameter)
+{
+    SoyuzSync *sync = (SoyuzSync *)parameter;
+    while (1)
+    {
+        if (sync->role == off)
+        {
+            delay(1000);
+            continue;
+        }
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        if (sync->role == leader && tv.tv_sec != sync->lastBeaconSec)
+        {
+            sync->lastBeaconSec = tv.tv_sec;
+            sync->sendBeacon();
+        }
+        sync->poll(1000000 - tv.tv_usec + 1000); // wakes just after the next second edge at the latest
+    }
+}
+
+// waits for one packet on either socket and stamps it as soon as lwip hands it over
+void SoyuzSync::poll(int32_t timeoutUs)
+{
+    fd_set ready;
+    FD_ZERO(&ready);
+    FD_SET(beaconSock, &ready);
+    FD_SET(exchangeSock, &ready);
+    struct timeval timeout = {timeoutUs / 1000000, timeoutUs % 1000000};
+    if (select((beaconSock > exchangeSock ? beaconSock : exchangeSock) + 1, &ready, NULL, NULL, &timeout) <= 0)
+        return;
+    Packet packet;
+    struct sockaddr_in from = {};
+    socklen_t fromLength = sizeof(from);
+    int sock = FD_ISSET(exchangeSock, &ready) ? exchangeSock : beaconSock;
+    int length = recvfrom(sock, &packet, sizeof(packet), 0, (struct sockaddr *)&from, &fromLength);
+    int64_t receivedUs = nowUs();
+    if (length != sizeof(packet) || memcmp(packet.magic, "SOYS", 4) != 0 || packet.version != SYNC_VERSION)
+        return; // not ours
+    Role current = role;
+    if (packet.type == beaconPacket && sock == beaconSock && current == follower)
+    {
+        burstLeft = burstSize - 1;
+        sendRequest(from); // the beacon came from the leader's exchange socket
+    }
+    else if (packet.type == requestPacket && sock == exchangeSock && current == leader)
+        sendReply(packet, from, receivedUs);
+    else if (packet.type == replyPacket && sock == exchangeSock && current == follower)
+        receiveReply(packet, from, receivedUs);
+}
+
+// once a second, only so followers know where to send requests. its timing doesn't matter
+void SoyuzSync::sendBeacon()
+{
+    Packet beacon = {{'S', 'O', 'Y', 'S'}, SYNC_VERSION, beaconPacket, sequence++, 0, {0, 0}, {0, 0}, {0, 0}};
+    struct sockaddr_in to = {};
+    to.sin_family = AF_INET;
+    to.sin_port = htons(port);
+    to.sin_addr.s_addr = inet_addr(SYNC_GROUP);
+    beacon.transmit = toStamp(nowUs());
+    if (sendto(exchangeSock, &beacon, sizeof(beacon), 0, (struct sockaddr *)&to, sizeof(to)) < 0)
+        LOG_WARN(LOG_CAT_NET, "sync beacon send failed, errno %d", errno);
+}
+
+// t1 is taken right before the send, so only the network path is left after it
+void SoyuzSync::sendRequest(const struct sockaddr_in &to)
+{
+    Packet request = {{'S', 'O', 'Y', 'S'}, SYNC_VERSION, requestPacket, ++pendingSequence, 0, {0, 0}, {0, 0}, {0, 0}};
+    pendingOrigin = nowUs();
+    request.origin = toStamp(pendingOrigin);
+    if (sendto(exchangeSock, &request, sizeof(request), 0, (const struct sockaddr *)&to, sizeof(to)) < 0)
+        pendingOrigin = 0;
+}
+
+void SoyuzSync::sendReply(Packet &request, const struct sockaddr_in &to, int64_t receivedUs)
+{
+    request.type = replyPacket; // origin and sequence go back as they came
+    request.receive = toStamp(receivedUs);
+    request.transmit = toStamp(nowUs());
+    sendto(exchangeSock, &request, sizeof(request), 0, (const struct sockaddr *)&to, sizeof(to));
+}
+
+void SoyuzSync::receiveReply(const Packet &reply, const struct sockaddr_in &from, int64_t receivedUs)
+{
+    int64_t t1 = fromStamp(reply.origin);
+    if (pendingOrigin == 0 || reply.sequence != pendingSequence || t1 != pendingOrigin)
+        return; // late reply to an older request
+    pendingOrigin = 0;
+    int64_t t2 = fromStamp(reply.receive);
+    int64_t t3 = fromStamp(reply.transmit);
+    int64_t delay = (receivedUs - t1) - (t3 - t2);
+    int64_t offset = ((t1 - t2) + (receivedUs - t3)) / 2;
+    exchanges++;
+    if (delay < 0)
+        rejected++; // a clock jumped between the stamps, the offset is as wrong as the delay
+    else if (!slewing()) // while the offset is still moving, a sample would correct twice
+        addSample(delay, offset);
+    if (exchanges % 60 == 0)
+        report();
+    // only now, so the next t1 is stamped on the corrected clock. a step cancels the burst in
+    // case the clock jumped, the next beacon starts a new one
+    if (burstLeft > 0)
+    {
+        burstLeft--;
+        sendRequest(from);
+    }
+}
+
+void SoyuzSync::addSample(int64_t delay, int64_t offset)
+{
+    // the exchange that queued least has the most symmetric path, the best offset estimate
+    if (delay < bestDelay)
+    {
+        bestDelay = delay;
+        bestOffset = offset;
+    }
+    samples++;
+    if (samples < windowSize && !(samples == 1 && llabs(offset) > stepThresholdUs)) // unset clocks step on the first one
+        return;
+    lastDelay = bestDelay > INT32_MAX ? INT32_MAX : (int32_t)bestDelay;
+    correctedAtMs = millis();
+    corrected = true;
+    if (correct(bestOffset))
+        burstLeft = 0;
+    bestDelay = INT64_MAX;
+    samples = 0;
+}
+
+bool SoyuzSync::correct(int64_t errorUs)
+{
+    int32_t error = errorUs > INT32_MAX ? INT32_MAX : errorUs < INT32_MIN ? INT32_MIN : (int32_t)errorUs;
+    lastError = error;
+    if (llabs(errorUs) > stepThresholdUs)
+    {
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        int64_t fixed = timevalUs(now) - errorUs;
+        now.tv_sec = fixed / 1000000;
+        now.tv_usec = fixed % 1000000;
+        settimeofday(&now, NULL);
+        steps++;
+        LOG_INFO(LOG_CAT_NET, "sync stepped %d ms to the leader", (int32_t)(-errorUs / 1000));
+        return true;
+    }
+    if (error < minError)
+        minError = error;
+    if (error > maxError)
+        maxError = error;
+    if (llabs(errorUs) < deadbandUs)
+        return false;
+    struct timeval delta = {0, (suseconds_t)-errorUs}; // under 100ms, so usec alone holds it
+    adjtime(&delta, NULL);
+    slews++;
+    return false;
+}
+
+void SoyuzSync::report()
+{
+    LOG_INFO(LOG_CAT_NET, "sync %u exchanges, offset us %d (min %d max %d), round trip us %d", exchanges, lastError,
+             minError == INT32_MAX ? 0 : minError, maxError == INT32_MIN ? 0 : maxError, lastDelay);
+    LOG_INFO(LOG_CAT_NET, "sync %u slews, %u steps, %u exchanges rejected", slews, steps, rejected);
+    minError = INT32_MAX;
+    maxError = INT32_MIN;
+}
@@ -0,0 +1,118 @@
+/*
+  Second-phase sync between clocks on one LAN. The leader multicasts a
+  beacon once a second so followers can find it. Each follower answers a
+  beacon with an NTP style exchange over unicast: it stamps a request (t1),
+  the leader stamps its arrival (t2) and the reply's departure (t3), and the
+  follower stamps the reply's arrival (t4). A beacon starts a short burst of
+  these, each request sent when the last reply is in. Then
+
+    offset = ((t1 - t2) + (t4 - t3)) / 2     how far ahead of the leader
+    delay  = (t4 - t1) - (t3 - t2)           round trip on the network
+
+  The path delay cancels out as long as it is about the same each way, so
+  unlike a one-way beacon the follower doesn't end up late by it (multicast
+  under WiFi power save can take several ms). Over a window of exchanges the
+  one with the smallest delay, the least queued, is used to slew the system
+  clock with adjtime, or step it with settimeofday when it is far out. An
+  exchange with a negative delay saw a clock jump and is dropped. The tick
+  task follows the system clock, so every display flips together.
+
+  The role can be changed at any time, "off" leaves the clock to SNTP.
+  test/host/test_sync runs a leader and followers from this code on one host.
+*/
+
+#ifndef SoyuzSync_h
+#define SoyuzSync_h
+#include "Arduino.h"
+#include "TaskConfig.h"
+
+struct sockaddr_in;
+
+class SoyuzSync
+{
+public:
+  enum Role
+  {
+    off,
+    leader,
+    follower,
+    num_roles
+  };
+
+  static const uint16_t port = 5315;             // beacons. exchanges use each clock's own port
+  static const int burstSize = 4;                // exchanges started by each beacon, back to back
+  static const int windowSize = 16;              // exchanges per correction
+  static const int32_t deadbandUs = 200;         // closer than this is left alone
+  static const int32_t stepThresholdUs = 100000; // further than this is stepped, not slewed
+  static const uint32_t syncedForMs = 60000;     // synced() after a correction, a window is ~4 s
+
+  SoyuzSync();
+  bool begin(const TaskConfig &config); // after WiFi is up
+  void setRole(Role newRole) { role = newRole; }
+  Role getRole() const { return role; }
+  int32_t lastErrorUs() const { return lastError; } // follower offset from the leader at the last correction
+  int32_t lastDelayUs() const { return lastDelay; } // round trip of the exchange that correction used
+  uint32_t stepCount() const { return steps; }
+  bool synced() const { return corrected && millis() - correctedAtMs < syncedForMs; } // follower, leader heard lately
+
+private:
+  enum PacketType : uint8_t
+  {
+    beaconPacket,
+    requestPacket,
+    replyPacket
+  };
+
+  struct __attribute__((packed)) Stamp
+  {
+    uint32_t sec;
+    uint32_t usec;
+  };
+
+  struct __attribute__((packed)) Packet
+  {
+    char magic[4]; // "SOYS"
+    uint8_t version;
+    uint8_t type;
+    uint8_t sequence;
+    uint8_t reserved;
+    Stamp origin;   // request: t1, echoed back in the reply
+    Stamp receive;  // reply: t2
+    Stamp transmit; // beacon and reply: when the leader sent it, t3 for a reply
+  };
+
+  static Stamp toStamp(int64_t us);
+  static int64_t fromStamp(const Stamp &stamp);
+  static void task(void *parameter);
+  void poll(int32_t timeoutUs);
+  void sendBeacon();
+  void sendRequest(const struct sockaddr_in &to);
+  void sendReply(Packet &request, const struct sockaddr_in &to, int64_t receivedUs);
+  void receiveReply(const Packet &reply, const struct sockaddr_in &from, int64_t receivedUs);
+  void addSample(int64_t delay, int64_t offset);
+  bool correct(int64_t errorUs); // true if it stepped the clock
+  void report();
+
+  volatile Role role;
+  int beaconSock;   // bound to port, in the multicast group
+  int exchangeSock; // beacons out, requests and replies
+  uint8_t sequence;
+  time_t lastBeaconSec;
+  int64_t pendingOrigin; // t1 of the request in flight, 0 if none
+  uint8_t pendingSequence;
+  int burstLeft;         // requests still to send after this one
+  int64_t bestDelay;     // smallest round trip in this window
+  int64_t bestOffset;
+  int samples;
+  volatile bool corrected; // at least once, correctedAtMs is valid
+  volatile uint32_t correctedAtMs;
+  volatile int32_t lastError;
+  volatile int32_t lastDelay;
+  int32_t minError, maxError;
+  uint32_t exchanges;
+  volatile uint32_t steps;
+  uint32_t slews;
+  uint32_t rejected; // negative round trips
+};
+
+#endif
@@ -0,0 +1,212 @@
+/*
+*/
+
+#include "Arduino.h"
+#include "SoyuzSynth.h"
+#include "esp_timer.h"
+#include <math.h>
+
+#define MS_TO_SAMPLES(ms) ((uint32_t)(ms) * SoyuzSynth::sampleRate / 1000)
+#define ENVELOPE_FULL (1L << 24) // Q24, so a release of a few seconds still steps at least 1 per sample
+
+int16_t SoyuzSynth::wavetable[256];
+
+// start, freq, length, waveform, gain, attack, decay, sustain, release
+static const SoyuzSynth::Note beepNotes[] = {
+    {0, 2000, 80, SoyuzSynth::square, 90, 2, 0, 255, 10}};
+// two bell-ish partials, struck hard and ringing on. the second strike comes while the first
+// still rings, so all four gains together stay within 255
+static const SoyuzSynth::Note chimeNotes[] = {
+    {0, 1319, 300, SoyuzSynth::sine, 90, 2, 250, 120, 1300},
+    {0, 3640, 120, SoyuzSynth::sine, 35, 1, 100, 60, 500},
+    {500, 1047, 300, SoyuzSynth::sine, 90, 2, 250, 120, 1600},
+    {500, 2890, 120, SoyuzSynth::sine, 35, 1, 100, 60, 600}};
+// four beeps, then silence for the rest of a second
+static const SoyuzSynth::Note alarmNotes[] = {
+    {0, 2600, 60, SoyuzSynth::square, 160, 2, 20, 200, 10},
+    {120, 2600, 60, SoyuzSynth::square, 160, 2, 20, 200, 10},
+    {240, 2600, 60, SoyuzSynth::square, 160, 2, 20, 200, 10},
+    {360, 2600, 60, SoyuzSynth::square, 160, 2, 20, 200, 10},
+    {999, 0, 0, SoyuzSynth::sine, 0, 0, 0, 0, 0}};
+// mechanical tick, a very short noise burst
+static const SoyuzSynth::Note tickNotes[] = {
+    {0, 0, 2, SoyuzSynth::noise, 70, 0, 0, 255, 4}};
+
+const SoyuzSynth::Pattern SoyuzSynth::beep = {beepNotes, sizeof(beepNotes) / sizeof(beepNotes[0])};
+const SoyuzSynth::Pattern SoyuzSynth::chime = {chimeNotes, sizeof(chimeNotes) / sizeof(chimeNotes[0])};
+const SoyuzSynth::Pattern SoyuzSynth::alarm = {alarmNotes, sizeof(alarmNotes) / sizeof(alarmNotes[0])};
+const SoyuzSynth::Pattern SoyuzSynth::tick = {tickNotes, sizeof(tickNotes) / sizeof(tickNotes[0])};
+
+SoyuzSynth::SoyuzSynth()
+    : voices(), requested(NULL), pattern(NULL), nextNote(0), patternSample(0), noiseState(1), samples(0), busyUs(0)
+{
+    for (int i = 0; i < 256; i++)
+        wavetable[i] = (int16_t)(sinf(i * 2.0f * (float)M_PI / 256.0f) * 32767.0f);
+}
+
+void SoyuzSynth::play(const Pattern &newPattern)
+{
+    requested = &newPattern;
+}
+
+bool SoyuzSynth::active() const
+{
+    if (requested || pattern)
+        return true;
+    for (int i = 0; i < numVoices; i++)
+    {
+        if (voices[i].on)
+            return true;
+    }
+    return false;
+}
+
+// takes a free voice, or the quietest one
+void SoyuzSynth::startNote(const Note &note)
+{
+    if (note.gain == 0) // rest, only there to pad the pattern length
+        return;
+    Voice *voice = &voices[0];
+    for (int i = 0; i < numVoices; i++)
+    {
+        if (!voices[i].on)
+        {
+            voice = &voices[i];
+            break;
+        }
+        if (voices[i].level < voice->level)
+            voice = &voices[i];
+    }
+    voice->phase = 0;
+    voice->increment = (uint32_t)(((uint64_t)note.freq << 32) / sampleRate);
+    voice->level = 0;
+    voice->attack = ENVELOPE_FULL / (MS_TO_SAMPLES(note.attackMs) + 1);
+    voice->sustainLevel = note.sustain * (ENVELOPE_FULL / 255);
+    voice->decay = (ENVELOPE_FULL - voice->sustainLevel) / (MS_TO_SAMPLES(note.decayMs) + 1);
+    voice->release = ENVELOPE_FULL / (MS_TO_SAMPLES(note.releaseMs) + 1);
+    voice->holdSamples = MS_TO_SAMPLES(note.lengthMs);
+    voice->gain = note.gain;
+    voice->waveform = note.waveform;
+    voice->attacking = true;
+    voice->on = true;
+}
+
+template <SoyuzSynth::Waveform W>
+void SoyuzSynth::renderVoice(Voice &voice, int32_t *mix, int frames)
+{
+    for (int i = 0; i < frames; i++)
+    {
+        int32_t sample;
+        if (W == sine)
+        {
+            // linear interpolation between table entries
+            uint32_t index = voice.phase >> 24;
+            int32_t frac = (voice.phase >> 16) & 0xFF;
+            int32_t a = wavetable[index];
+            int32_t b = wavetable[(index + 1) & 0xFF];
+            sample = a + (((b - a) * frac) >> 8);
+        }
+        else if (W == square)
+        {
+            sample = (voice.phase & 0x80000000) ? 24000 : -24000;
+        }
+        else
+        {
+            noiseState = noiseState * 1664525 + 1013904223;
+            sample = (int32_t)(noiseState >> 16) - 32768;
+        }
+        voice.phase += voice.increment;
+
+        if (voice.holdSamples)
+        {
+            voice.holdSamples--;
+            if (voice.attacking)
+            {
+                voice.level += voice.attack;
+                if (voice.level >= ENVELOPE_FULL)
+                {
+                    voice.level = ENVELOPE_FULL;
+                    voice.attacking = false;
+                }
+            }
+            else if (voice.level > voice.sustainLevel)
+            {
+                voice.level -= voice.decay;
+                if (voice.level < voice.sustainLevel)
+                    voice.level = voice.sustainLevel;
+            }
+        }
+        else
+        {
+            voice.level -= voice.release;
+            if (voice.level <= 0)
+            {
+                voice.level = 0;
+                voice.on = false;
+                return;
+            }
+        }
+        mix[i] += (((sample * voice.gain) >> 8) * (voice.level >> 9)) >> 15;
+    }
+}
+
+void SoyuzSynth::render(int16_t *out, int frames)
+{
+    uint32_t start = esp_timer_get_time();
+    int32_t mix[blockFrames];
+    if (frames > blockFrames)
+        frames = blockFrames;
+    memset(mix, 0, sizeof(mix[0]) * frames);
+
+    const Pattern *newPattern = requested;
+    if (newPattern)
+    {
+        requested = NULL;
+        pattern = newPattern;
+        nextNote = 0;
+        patternSample = 0;
+    }
+    // notes start on block boundaries, close enough at 2.9ms
+    if (pattern)
+    {
+        uint32_t blockEnd = patternSample + frames;
+        while (nextNote < pattern->count && MS_TO_SAMPLES(pattern->notes[nextNote].startMs) < blockEnd)
+            startNote(pattern->notes[nextNote++]);
+        patternSample = blockEnd;
+        if (nextNote >= pattern->count)
+            pattern = NULL;
+    }
+
+    for (int v = 0; v < numVoices; v++)
+    {
+        Voice &voice = voices[v];
+        if (!voice.on)
+            continue;
+        // the waveform is picked once per block, the per sample loop is branch free on it
+        switch (voice.waveform)
+        {
+        case sine:
+            renderVoice<sine>(voice, mix, frames);
+            break;
+        case square:
+            renderVoice<square>(voice, mix, frames);
+            break;
+        default:
+            renderVoice<noise>(voice, mix, frames);
+            break;
+        }
+    }
+
+    for (int i = 0; i < frames; i++)
+    {
+        int32_t s = mix[i];
+        if (s > 32767)
+            s = 32767;
+        else if (s < -32768)
+            s = -32768;
+        out[i * 2] = s;
+        out[i * 2 + 1] = s;
+    }
+    samples += frames;
+    busyUs += (uint32_t)esp_timer_get_time() - start;
+}
@@ -0,0 +1,94 @@
+/*
+  Procedural sound for the clock, no SD card or MP3 decode needed. A few
+  fixed-point voices (256 entry wavetable oscillators with ADSR envelopes)
+  are rendered a block at a time into interleaved 16 bit stereo, ready for
+  I2SStream::write. A note ramps up over attackMs, falls to its sustain level
+  over decayMs and stays there until lengthMs from its start, then fades out
+  over releaseMs. The gains of notes that can sound together add up to 255 at
+  most, so the mix never clips. Sounds are short note patterns, started from
+  any task with play() and picked up at the next block.
+*/
+
+#ifndef SoyuzSynth_h
+#define SoyuzSynth_h
+#include "Arduino.h"
+
+class SoyuzSynth
+{
+public:
+  static const uint32_t sampleRate = 44100;
+  static const int blockFrames = 128; // ~2.9ms
+  static const int numVoices = 4;
+
+  enum Waveform : uint8_t
+  {
+    sine,
+    square,
+    noise
+  };
+
+  struct Note
+  {
+    uint16_t startMs; // from the start of the pattern
+    uint16_t freq;    // Hz, ignored for noise
+    uint16_t lengthMs; // until the release, attack and decay included
+    Waveform waveform;
+    uint8_t gain;      // 0-255
+    uint8_t attackMs;
+    uint16_t decayMs;
+    uint8_t sustain;   // level after the decay, 0-255 of the peak
+    uint16_t releaseMs;
+  };
+
+  struct Pattern
+  {
+    const Note *notes;
+    uint8_t count;
+  };
+
+  static const Pattern beep;
+  static const Pattern chime;
+  static const Pattern alarm;
+  static const Pattern tick;
+
+  SoyuzSynth();
+  void play(const Pattern &pattern); // thread safe, replaces whatever pattern is playing
+  bool active() const;
+  void render(int16_t *out, int frames); // interleaved stereo, frames <= blockFrames
+  uint32_t renderedSamples() const { return samples; }
+  uint32_t renderUs() const { return busyUs; }
+  void resetStats() { samples = busyUs = 0; }
+
+private:
+  struct Voice
+  {
+    uint32_t phase;
+    uint32_t increment;
+    int32_t level;   // envelope, Q24
+    int32_t attack;  // per sample, Q24
+    int32_t decay;   // per sample, Q24
+    int32_t sustainLevel;
+    int32_t release; // per sample, Q24
+    uint32_t holdSamples; // left until the release
+    uint8_t gain;
+    Waveform waveform;
+    bool attacking;
+    bool on;
+  };
+
+  void startNote(const Note &note);
+  template <Waveform W>
+  void renderVoice(Voice &voice, int32_t *mix, int frames);
+
+  static int16_t wavetable[256];
+  Voice voices[numVoices];
+  const Pattern *volatile requested;
+  const Pattern *pattern;
+  uint8_t nextNote;
+  uint32_t patternSample;
+  uint32_t noiseState;
+  uint32_t samples;
+  uint32_t busyUs;
+};
+
+#endif
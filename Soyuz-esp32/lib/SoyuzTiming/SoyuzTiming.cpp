@@ -0,0 +1,31 @@
+/*
+*/
+
+#include "Arduino.h"
+#include "SoyuzTiming.h"
+
+LatencyStats::LatencyStats(uint32_t budget) : budgetUs(budget)
+{
+    reset();
+}
+
+void LatencyStats::record(uint32_t us)
+{
+    if (samples == 0 || us < minUs)
+        minUs = us;
+    if (us > maxUs)
+        maxUs = us;
+    if (us > budgetUs)
+        overBudgetCount++;
+    totalUs += us;
+    samples++;
+}
+
+void LatencyStats::reset()
+{
+    samples = 0;
+    minUs = 0;
+    maxUs = 0;
+    totalUs = 0;
+    overBudgetCount = 0;
+}
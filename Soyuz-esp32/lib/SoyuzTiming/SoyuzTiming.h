@@ -0,0 +1,32 @@
+/*
+  Latency statistics in microseconds. Collects min/avg/max and how many
+  samples went over a budget; the owner logs and resets it periodically.
+  Not thread safe, record and read from one task.
+*/
+
+#ifndef SoyuzTiming_h
+#define SoyuzTiming_h
+#include "Arduino.h"
+
+class LatencyStats
+{
+public:
+  LatencyStats(uint32_t budget);
+  void record(uint32_t us);
+  void reset();
+  uint32_t count() const { return samples; }
+  uint32_t min() const { return samples ? minUs : 0; }
+  uint32_t max() const { return maxUs; }
+  uint32_t avg() const { return samples ? totalUs / samples : 0; }
+  uint32_t overBudget() const { return overBudgetCount; }
+
+private:
+  uint32_t budgetUs;
+  uint32_t samples;
+  uint32_t minUs;
+  uint32_t maxUs;
+  uint64_t totalUs;
+  uint32_t overBudgetCount;
+};
+
+#endif
@@ -3,21 +3,71 @@
 #include <EEPROM.h>
 #include <WiFi.h>
 #include <time.h>
+#include <esp_timer.h>
 
 #include <SoyuzDisplay.h>
+#include <SoyuzBrightness.h>
+#include <SoyuzAnimator.h>
+#include <SoyuzLog.h>
+#include <SoyuzAlloc.h>
+#include <SoyuzInput.h>
+#include <SoyuzTiming.h>
+#include <SoyuzPower.h>
+#include <SoyuzSequence.h>
+#include "TaskConfig.h"
+#include "esp32/rtc.h"
+#include "driver/gpio.h"
+
+// #define ENABLE_SEQUENCES // boot splash and display sequences from the SD card
+
+#if defined(ENABLE_SOUND) || defined(ENABLE_SEQUENCES)
+#define ENABLE_SD
+#endif
 
-#ifdef ENABLE_SOUND
+#ifdef ENABLE_SD
 #include <SPI.h>
 #include <SD.h>
+#include <SoyuzAssets.h>
+#endif
+
+// #define ENABLE_SYNTH // built in beeps, chimes and alarm on I2S, no SD card needed
+// #define ENABLE_TICK_SOUND // mechanical tick every second, needs ENABLE_SYNTH
+
+#if defined(ENABLE_SOUND) || defined(ENABLE_SYNTH)
+#define ENABLE_I2S
+#endif
+
+#ifdef ENABLE_I2S
 #include "AudioTools.h"
+#include <SoyuzMixer.h>
+#endif
+#ifdef ENABLE_SOUND
 #include "AudioCodecs/CodecMP3Helix.h"
 #endif
+#ifdef ENABLE_SYNTH
+#include <SoyuzSynth.h>
+#endif
 
 #define ENABLE_WIFI
+#define ENABLE_API // JSON control API on :8080 and display frames over WebSocket on :8081, needs ENABLE_WIFI
 
 #ifdef ENABLE_WIFI
 #include <WiFiManager.h>
 #endif
+#ifdef ENABLE_API
+#include <SoyuzApi.h>
+#endif
+#define ENABLE_SYNC // leader/follower second-phase sync between clocks on the LAN, needs ENABLE_WIFI
+#ifdef ENABLE_SYNC
+#include <SoyuzSync.h>
+#include "esp_sntp.h"
+#endif
+
+// SOYUZ_WIFI_STRESS floods the LAN with UDP from core 0 to check the clock core stays
+// isolated. test builds only, set by the esp-wrover-kit-wifi-stress env in platformio.ini
+#ifdef SOYUZ_WIFI_STRESS
+#include <WiFiUdp.h>
+#endif
 
 // EEPROM ADDRESSES
 #define EEPROM_CRC_ADDRESS 0
@@ -38,20 +88,72 @@
 #define RTC_SCL_PIN 22
 #define RTC_SDA_PIN 21
 
-#define RUN_CORRECT_SW_PIN 39 // VN
-#define OP_SW_PIN 34
-#define ON_SW_PIN 35
-#define START_STOP_BUT_PIN 33
-#define ENTER_BUT_PIN 32
+// switches and buttons. all in GPIO bank 1 (32-39) so one register read samples them all
+constexpr uint8_t RUN_CORRECT_SW_PIN = 39; // VN
+constexpr uint8_t OP_SW_PIN = 34;
+constexpr uint8_t ON_SW_PIN = 35;
+constexpr uint8_t START_STOP_BUT_PIN = 33;
+constexpr uint8_t ENTER_BUT_PIN = 32;
 
 // Setup Devices
+InputBank<RUN_CORRECT_SW_PIN, OP_SW_PIN, ON_SW_PIN, START_STOP_BUT_PIN, ENTER_BUT_PIN> inputs;
 SoyuzDisplay display = SoyuzDisplay(MAX_DATA_PIN, MAX_CLK_PIN, MAX_LOAD_PIN);
+SoyuzBrightness brightness(display);
+SoyuzAnimator animator(display);
+const uint32_t animationFrameUs = 25000; // 40 fps
+#ifdef ENABLE_SD
+SoyuzAssets assets; // index of the card, built once at boot
+#endif
+#ifdef ENABLE_I2S
+I2SStream i2s; // fed only by the mixer
+SoyuzMixer mixer;
+TaskHandle_t audioTaskHandle = NULL;
+const int i2sBufferCount = 3; // DMA buffers of one mixer block each
+const uint32_t i2sQueueUs = (uint64_t)i2sBufferCount * SoyuzMixer::blockFrames * 1000000 / SoyuzSynth::sampleRate;
+std::atomic<uint32_t> soundRequestUs(0); // when the last sound was asked for, 0 once it is queued
+LatencyStats soundLatencyStats(15000); // request -> its first block in the DMA queue
+#endif
+#ifdef ENABLE_SYNTH
+SoyuzSynth synth;
+SynthSource synthVoice(synth);
+PcmSource clickVoice; // seconds tick, rendered once at boot
+int16_t *tickPcm = NULL;
+size_t tickFrames = 0;
+#endif
 #ifdef ENABLE_SOUND
 // Audio and SD card
-I2SStream i2s;                                           // final output of decoded stream
-EncodedAudioStream decoder(&i2s, new MP3DecoderHelix()); // Decoding stream
-StreamCopy copier;
+StreamSource mp3Voice(16384);                                 // decoded PCM waiting for the mixer
+const size_t mp3Headroom = 2 * 1152 * 4;                      // two decoded MP3 frames
+EncodedAudioStream decoder(&mp3Voice, new MP3DecoderHelix()); // Decoding stream
+StreamCopy copier(256);                                       // small copies, so one never decodes more than mp3Headroom
 File audioFile;
+AssetReader audioReader; // double buffered read ahead between the card and the decoder
+#endif
+
+// Power locks, held only while the clock code needs full speed
+PowerLock tickLock("tick");
+PowerLock displayLock("display");
+PowerLock *powerLocks[] = {&tickLock, &displayLock};
+#ifdef ENABLE_I2S
+PowerLock audioLock("audio", ESP_PM_APB_FREQ_MAX); // I2S needs a steady APB clock
+#endif
+TaskHandle_t loopTaskHandle = NULL; // woken by the time task on each new second
+#ifdef ENABLE_WIFI
+TaskHandle_t networkTaskHandle = NULL;
+volatile bool portalRequested = false; // set by checkPortalHold, served by the network task
+bool portalHoldArmed = false;
+unsigned long portalHoldStart = 0;
+#endif
+#ifdef ENABLE_API
+SoyuzApi api;
+// requests from the API, applied by loop() so clock state only changes on core 1
+volatile bool apiStopWatchPress = false;
+volatile bool apiAlarmSet = false;
+uint8_t apiAlarm[3];
+#endif
+#ifdef ENABLE_SYNC
+SoyuzSync clockSync; // started on the first connect, in normal mode only
+bool syncStarted = false;
 #endif
 
 // Mutexs
@@ -64,6 +166,7 @@ unsigned long lastButtonPress = 0;
 // Not sure if this is the best way to do this
 unsigned long refreshDateDisplayTimer = 0;
 unsigned long refreshAlarmDisplayTimer = 0;
+unsigned long powerReportTimer = 0;
 // DateTime Vars
 uint8_t hour = 0, minute = 0, second = 0, month = 0, day = 0;
 uint8_t alarmHour = 0, alarmMinute = 0, alarmSecond = 0;
@@ -73,6 +176,11 @@ int timeDots = 0;
 int lastsecond = -1;
 int lastsecondTime = -1;
 int lastsecondStopWatch = -1;
+int lastAlarmFired = -1; // second of the day each sound last went off, so each fires once per match
+int lastChimeFired = -1;
+// tick to display jitter. esp_timer time of the last second edge, set by the time task
+volatile uint32_t tickEdgeUs = 0;
+LatencyStats tickToDisplayStats(5000);
 
 // Struct for clock user settings
 struct DeviceSettings
@@ -90,10 +198,41 @@ struct DeviceSettings
   };
   modes defualtMode;
   modes currentMode;
+  // brightness schedule, normal mode only. start == end disables a window
+  int dimStartHour;
+  int dimEndHour;
+  int displayOffHour;
+  int displayOnHour;
+  int dimLevel; // perceptual 1-255
+  uint8_t digitTransition; // SoyuzAnimator::Transition
+  uint8_t syncRole;        // SoyuzSync::Role
 };
+static_assert(SETTINGS_ADDRESS + sizeof(DeviceSettings) <= 128, "settings outgrew the EEPROM area");
 DeviceSettings settings;
 
 DeviceSettings::modes clockMode; // are we emulating the real thing?
+
+// clock state that survives software, watchdog and panic resets (not power loss),
+// saved by the time task every second. RTC_NOINIT_ATTR because RTC_DATA_ATTR is
+// reloaded from flash on every boot except a deep sleep wake
+struct WarmState
+{
+  int64_t timeUs; // system time when saved
+  uint64_t rtcUs; // RTC slow clock when saved, it keeps counting through a reset
+  uint8_t clockMode;
+  bool alarmEnable;
+  uint8_t alarm[3];
+  uint8_t stopWatchMode;
+  bool stopWatchRunning;
+  uint8_t stopWatchMinute;
+  uint8_t stopWatchSecond;
+  char timeZone[33]; // the TZ configTime set, so local time is right before it runs again
+  uint32_t crc;      // of everything above
+};
+RTC_NOINIT_ATTR WarmState warmState;
+bool warmBoot = false; // this boot picked up from warmState
+char timeZone[33] = "";  // getenv("TZ") after configTime, UTC in emulation mode
+
 bool alarmEnable = false;
 int stopWatchMode = 0; // 0 = reset, 1= start, 2=stop
 bool stopWatchRunning = false;
@@ -104,19 +243,45 @@ void emulationMode();
 void normalMode();
 boolean readButton(uint8_t pin);
 void updateDateTimeTask(void *parameter);
+void waitForSecondEdge();
+void inputISR(void *arg);
 void displayTime();
 void displayDate();
 void displayAlarm();
 void stopWatchTask(void *parameter);
-bool wifiManagerSetup(bool adhoc);
+void animationTask(void *parameter);
+void audioTask(void *parameter);
+void i2sBegin();
+#ifdef ENABLE_SYNTH
+void playSound(const SoyuzSynth::Pattern &pattern);
+void renderTick();
+void playTick();
+#endif
+#ifdef SOYUZ_WIFI_STRESS
+void wifiStressTask(void *parameter);
+#endif
+void networkTask(void *parameter);
+void wifiManagerSetup();
+void checkPortalHold();
+void applyTimeSettings();
+void apiRoutes();
+void applyApiRequests();
 
 bool setTime(int time[]); // 1 we set time, 0 we exited without changing time
 
 boolean isBetweenHours(int hour, int displayOffHour, int displayOn);
 uint32_t calculateCRC(const DeviceSettings &settings);
+uint32_t calculateCRC(const uint8_t *data, int dataSize);
+void saveWarmState();
+bool restoreWarmState();
+void showRestoredTime();
+void publishTime(const struct tm &timeinfo);
+uint8_t shownHour(DeviceSettings::modes mode);
 bool readEEPROMWithCRC(DeviceSettings &settings);
 void writeEEPROMWithCRC(const DeviceSettings &settings);
 void initWiFi();
+void updateBrightness();
+bool playSequence(const char *path);
 
 void setup()
 {
@@ -129,7 +294,14 @@ void setup()
   delay(50);
   Serial.begin(115200);
   Serial.println("ON");
+  SoyuzLog::begin(logTaskConfig); // drain log records to serial at low priority
   displayMutex = xSemaphoreCreateMutex();
+  loopTaskHandle = xTaskGetCurrentTaskHandle();
+  tickLock.begin();
+  displayLock.begin();
+#ifdef ENABLE_I2S
+  audioLock.begin();
+#endif
 
   EEPROM.begin(128);
   bool settingsValid = readEEPROMWithCRC(settings);
@@ -152,6 +324,13 @@ void setup()
     settings.normalModeAlarm[0] = 0;
     settings.normalModeAlarm[1] = 0;
     settings.normalModeAlarm[2] = 0;
+    settings.dimStartHour = 22;
+    settings.dimEndHour = 7;
+    settings.displayOffHour = 0;
+    settings.displayOnHour = 0;
+    settings.dimLevel = 60;
+    settings.digitTransition = SoyuzAnimator::cut;
+    settings.syncRole = 0; // off
 
     writeEEPROMWithCRC(settings);
     EEPROM.commit();
@@ -160,36 +339,37 @@ void setup()
   {
     Serial.println("CRC GOOD");
   }
-  display.writeStringToDisplay("RESET SOYUZ ERR WIFI");
-  display.writeSoyuz();
-
-#ifdef ENABLE_WIFI
-  unsigned long resetTime = millis();
-  while (!digitalRead(ENTER_BUT_PIN))
+  warmBoot = restoreWarmState(); // before anything slow, the time is already running again
+  if (warmBoot)
+    showRestoredTime();
+#ifdef ENABLE_SD
+  SD.begin(SD_CS_PIN, SPI, 20000000, "/sd", SoyuzAssets::maxOpenFiles + 2);
+  assets.begin(SD);
+#endif
+  if (!warmBoot && !playSequence("/boot.sq")) // authored splash if the card has one, none after a crash
   {
-    delay(500);
-    Serial.println("SET");
-    display.writeStringToDisplay("SET");
-    if (millis() > resetTime + 5000UL)
-    {                         // if held down for 5 seconds
-      wifiManagerSetup(true); // adhoc change settings
-    }
+    display.writeStringToDisplay("RESET SOYUZ ERR WIFI");
+    display.writeSoyuz();
   }
 
-  // wifiManagerSetup(true);
-  if (!wifiManagerSetup(false)) // if we fail to connect to wifi, fall back to emulation mode
-  {
-    settings.currentMode = DeviceSettings::emulationMode;
-    display.writeStringToDisplay("FAIL  CONN");
-    delay(5000);
-  }
+#ifdef ENABLE_WIFI
+  // connecting and the config portal run on core 0, the clock starts straight away.
+  // holding ENTER through boot opens the portal once it has been down 5 seconds (see checkPortalHold)
+  WiFi.mode(WIFI_STA); // explicitly set mode, esp defaults to STA+AP. also brings up the netif configTime needs
+  inputs.sample();
+  portalHoldArmed = !warmBoot && inputs.isLow(ENTER_BUT_PIN);
+  portalHoldStart = millis();
+#ifdef ENABLE_API
+  apiRoutes();
+#endif
+  startTask(networkTask, networkTaskConfig, NULL, &networkTaskHandle);
 #endif
 #ifndef ENABLE_WIFI
   settings.currentMode = DeviceSettings::emulationMode; // force emulation mode if wifi is not enabled
 #endif
 
   settings.currentMode = DeviceSettings::normalMode;
-  clockMode = settings.currentMode;
+  clockMode = warmBoot ? (DeviceSettings::modes)warmState.clockMode : settings.currentMode;
 
   if (settings.currentMode != settings.defualtMode) // we booted into a different mode at the request of the user
   {
@@ -198,7 +378,12 @@ void setup()
     Serial.println("Setting defualt mode back");
   }
 
-  if (clockMode == DeviceSettings::emulationMode)
+  if (clockMode == DeviceSettings::emulationMode && warmBoot)
+  {
+    timeDots = 1; // time and the rest already restored
+    startTask(updateDateTimeTask, timeTaskConfig);
+  }
+  else if (clockMode == DeviceSettings::emulationMode)
   {
     struct tm timeinfo;
     timeinfo.tm_hour = 0;
@@ -212,44 +397,81 @@ void setup()
     settimeofday(&tv, nullptr); // Set the system time
     timeDots = 1;
     delay(500);
-    xTaskCreate(updateDateTimeTask, "updateDateTimeTask", 4096, NULL, 1, NULL);
+    startTask(updateDateTimeTask, timeTaskConfig);
   }
   else
   {
-    configTime(settings.gmtOffset_sec, settings.daylightOffset_sec, settings.ntpServer);
-    alarmHour = settings.normalModeAlarm[0];
-    alarmMinute = settings.normalModeAlarm[1];
-    alarmSecond = settings.normalModeAlarm[2];
-    delay(500);
-    xTaskCreate(updateDateTimeTask, "updateDateTimeTask", 4096, NULL, 1, NULL);
+    applyTimeSettings(); // SNTP keeps retrying until the network task is connected
+    if (!warmBoot) // restored time runs until SNTP corrects it
+    {
+      alarmHour = settings.normalModeAlarm[0];
+      alarmMinute = settings.normalModeAlarm[1];
+      alarmSecond = settings.normalModeAlarm[2];
+      delay(500);
+    }
+    startTask(updateDateTimeTask, timeTaskConfig);
   }
+  if (warmBoot && stopWatchMode != 0)
+  {
+    xSemaphoreTake(displayMutex, portMAX_DELAY); // the network task may be copying the frame by now
+    display.writeTimeToSmallDisplay(stopWatchMinute, stopWatchSecond, 0);
+    xSemaphoreGive(displayMutex);
+    if (stopWatchRunning)
+      startTask(stopWatchTask, stopWatchTaskConfig);
+  }
+#ifdef SOYUZ_WIFI_STRESS
+  startTask(wifiStressTask, wifiStressTaskConfig);
+#endif
 
-// setCpuFrequencyMhz(80); // slow down for power savings
+  // slow down for power savings. DFS between 80 and 240 MHz, light sleep when idle,
+  // and the buttons wake the CPU so a press is never held up by a sleep
+  attachInterruptArg(RUN_CORRECT_SW_PIN, inputISR, (void *)RUN_CORRECT_SW_PIN, CHANGE);
+  attachInterruptArg(OP_SW_PIN, inputISR, (void *)OP_SW_PIN, CHANGE);
+  attachInterruptArg(ON_SW_PIN, inputISR, (void *)ON_SW_PIN, CHANGE);
+  attachInterruptArg(START_STOP_BUT_PIN, inputISR, (void *)START_STOP_BUT_PIN, ONLOW);
+  attachInterruptArg(ENTER_BUT_PIN, inputISR, (void *)ENTER_BUT_PIN, ONLOW);
+  SoyuzPower::enableButtonWakeup(START_STOP_BUT_PIN);
+  SoyuzPower::enableButtonWakeup(ENTER_BUT_PIN);
+  SoyuzPower::begin(240, 80, true);
+#ifdef ENABLE_I2S
+  i2sBegin();
+#endif
+#ifdef ENABLE_SYNTH
+  renderTick();
+  mixer.addVoice(&synthVoice);
+  mixer.addVoice(&clickVoice);
+#endif
 #ifdef ENABLE_SOUND
   // SD Card and audio stuff
 
   AudioLogger::instance().begin(Serial, AudioLogger::Info);
 
   // setup file
-  SD.begin();
-  audioFile = SD.open("/sound2.mp3");
-
-  // setup i2s
-  auto config = i2s.defaultConfig(TX_MODE);
-  config.pin_bck = 15;
-  config.pin_ws = 13;
-  config.pin_data = 4;
-  i2s.begin(config);
-  pinMode(2, OUTPUT);
-
-  // setup I2S based on sampling rate provided by decoder
-  decoder.setNotifyAudioChange(i2s);
+  audioFile = assets.open("/sound2.mp3");
+  audioReader.begin(assetReaderTaskConfig);
+  audioReader.open(audioFile);
+
+  // the mixer runs at a fixed 44.1kHz stereo, so the MP3 must be too
+  if (!mp3Voice.begin())
+    LOG_ERROR(LOG_CAT_AUDIO, "no memory for the MP3 ring");
+  mp3Voice.restart();
+  mixer.addVoice(&mp3Voice, 192); // a little under the beeps
   decoder.begin();
 
   // begin copy
-  copier.begin(decoder, audioFile);
-
+  copier.begin(decoder, audioReader);
+#endif
+#ifdef ENABLE_I2S
+  startTask(audioTask, audioTaskConfig, NULL, &audioTaskHandle);
 #endif
+  // digit transitions only once boot messages are done, from here on every write holds displayMutex
+  TaskHandle_t animationTaskHandle;
+  startTask(animationTask, animationTaskConfig, NULL, &animationTaskHandle);
+  animator.begin(animationTaskHandle, animationFrameUs);
+  animator.setTransition((SoyuzAnimator::Transition)settings.digitTransition);
+  display.attachAnimator(&animator);
+
+  ALLOC_MARK_STEADY_STATE(); // nothing on the clock paths should touch the heap from here on
 }
 
 void loop()
@@ -261,22 +483,18 @@ void loop()
   //   in addition, we need to read 2 buttons and determine what action they take based on some of the switches
   //   we need to work on implementing the soyuz functionality, then implement extra functionality
   //   the function of the buttons should depend on the current mode, either emulation or normal
-#ifdef ENABLE_SOUND
-  if (!copier.copy())
-  {
-    stop();
-  }
+  inputs.sample(); // one snapshot of every switch and button per pass
+  updateBrightness(); // BKL, On Off Switch and the dim/off schedule
+#ifdef ENABLE_WIFI
+  checkPortalHold();
+#endif
+#ifdef ENABLE_API
+  applyApiRequests();
 #endif
-  if (digitalRead(ON_SW_PIN)) // BKL, On Off Switch, ON
-  {
-  }
-  else // OFF
-  {
-  }
 
-  if (digitalRead(RUN_CORRECT_SW_PIN)) // RUN
+  if (inputs.isHigh(RUN_CORRECT_SW_PIN)) // RUN
   {
-    if (digitalRead(OP_SW_PIN)) // current time
+    if (inputs.isHigh(OP_SW_PIN)) // current time
     {
       displayTime();
     }
@@ -287,7 +505,7 @@ void loop()
   }
   else // CORRECTION
   {
-    if (digitalRead(OP_SW_PIN)) // current time
+    if (inputs.isHigh(OP_SW_PIN)) // current time
     {
       if (clockMode == DeviceSettings::emulationMode) // if emulation, allow to set time
       {
@@ -336,8 +554,19 @@ void loop()
   {
     displayDate(); // otherwise, display the date
   }
-  if (readButton(START_STOP_BUT_PIN)) // stop watch button pressed
+  bool stopWatchPressed = readButton(START_STOP_BUT_PIN);
+#ifdef ENABLE_API
+  if (apiStopWatchPress)
+  {
+    apiStopWatchPress = false;
+    stopWatchPressed = true;
+  }
+#endif
+  if (stopWatchPressed) // stop watch button pressed
   {
+#ifdef ENABLE_SYNTH
+    playSound(SoyuzSynth::beep);
+#endif
     stopWatchMode++;
     if (stopWatchMode > 2)
       stopWatchMode = 0;
@@ -360,7 +589,7 @@ void loop()
         stopWatchRunning = true;
         stopWatchMinute = 0;
         stopWatchSecond = 0;
-        xTaskCreate(stopWatchTask, "stopWatchTask", 4096, NULL, 1, NULL);
+        startTask(stopWatchTask, stopWatchTaskConfig);
         // stop watch task runs in background
       }
       break;
@@ -372,20 +601,74 @@ void loop()
   }
 
   // alarm section
-  if (alarmEnable)
+#ifdef ENABLE_SYNTH
+  int secondOfDay = hour * 3600 + minute * 60 + second;
+  if (alarmEnable && alarmHour == hour && alarmMinute == minute && alarmSecond == second)
   {
-    if (alarmMinute == minute && alarmSecond == second)
+    if (lastAlarmFired != secondOfDay) // loop() passes more than once a second
     {
-      // TODO: Trigger alarm
+      lastAlarmFired = secondOfDay;
+      playSound(SoyuzSynth::alarm);
     }
   }
+  else
+  {
+    lastAlarmFired = -1; // armed again for tomorrow
+  }
+  if (clockMode == DeviceSettings::normalMode && minute == 0 && second == 0)
+  {
+    if (lastChimeFired != secondOfDay)
+    {
+      lastChimeFired = secondOfDay;
+      playSound(SoyuzSynth::chime); // on the hour
+    }
+  }
+  else
+  {
+    lastChimeFired = -1;
+  }
+#endif
+
+  if (millis() - powerReportTimer > 600000UL) // power state report every 10 minutes
+  {
+    powerReportTimer = millis();
+    SoyuzPower::report(powerLocks, sizeof(powerLocks) / sizeof(powerLocks[0]));
+  }
+
+  // block until the next second, a switch edge, a button press or an API request. only while
+  // a button is down (debounce, the portal hold) does it poll, its ISR stays masked until release.
+  // a brightness fade polls too, 20 ms is finer than its 16 intensity steps over 300 ms
+  bool buttonDown = inputs.isLow(START_STOP_BUT_PIN) || inputs.isLow(ENTER_BUT_PIN);
+  if (!buttonDown)
+  {
+    gpio_intr_enable((gpio_num_t)START_STOP_BUT_PIN);
+    gpio_intr_enable((gpio_num_t)ENTER_BUT_PIN);
+  }
+  TickType_t wait = pdMS_TO_TICKS(1000); // 1s in case no time task runs
+  if (buttonDown)
+    wait = pdMS_TO_TICKS(10);
+  else if (brightness.busy())
+    wait = pdMS_TO_TICKS(20);
+  ulTaskNotifyTake(pdTRUE, wait);
+}
+
+// wakes loop() on input changes. the buttons are low level triggered, the same as their light
+// sleep wakeup, so a press masks its own interrupt and loop() unmasks it once released
+void inputISR(void *arg)
+{
+  uint32_t pin = (uint32_t)arg;
+  if (pin == START_STOP_BUT_PIN || pin == ENTER_BUT_PIN)
+    gpio_intr_disable((gpio_num_t)pin);
+  BaseType_t woken = pdFALSE;
+  if (loopTaskHandle)
+    vTaskNotifyGiveFromISR(loopTaskHandle, &woken);
+  if (woken)
+    portYIELD_FROM_ISR();
 }
 boolean readButton(uint8_t pin) // true if button pressed
 {
-  // Read the button state
-  uint8_t btnState = digitalRead(pin);
-  // If we detect LOW signal, button is pressed
-  if (btnState == LOW)
+  // If the last sample is LOW, button is pressed
+  if (inputs.isLow(pin))
   {
     // if 50ms have passed since last LOW pulse, it means that the
     // button has been pressed, released and pressed again
@@ -406,15 +689,36 @@ boolean readButton(uint8_t pin) // true if button pressed
     return false;
   }
 }
-void setVfdMatrixTransition()
+// steps digit transitions, woken by the animator's frame timer while anything animates
+void animationTask(void *parameter)
 {
-  // uint8_t digits[3] = {settings.matrix_transition, 255, settings.vfd_transition};
-  // uint8_t minValues[3] = {0, 0, 0};
-  // uint8_t maxValues[3] = {INS1Matrix::num_enums - 1, 0, IV17::num_enums - 1};
-  // userInputClock(digits, minValues, maxValues, ALLOFF);
-  // settings.matrix_transition = (INS1Matrix::TransitionMode)digits[0];
-  // settings.vfd_transition = (IV17::TransitionMode)digits[2];
-  writeEEPROMWithCRC(settings);
+  LatencyStats frameStats(2000); // budget per frame, well under the 25ms period
+  uint32_t skippedFrames = 0;
+  while (1)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    uint32_t start = esp_timer_get_time();
+    if (xSemaphoreTake(displayMutex, 0)) // never make the tick wait, drop the frame instead
+    {
+      PowerGuard power(displayLock);
+      animator.frame();
+      xSemaphoreGive(displayMutex);
+    }
+    else
+    {
+      skippedFrames++;
+    }
+    frameStats.record((uint32_t)esp_timer_get_time() - start);
+    if (frameStats.count() >= 400)
+    {
+      LOG_INFO(LOG_CAT_DISPLAY, "anim frame us min %u avg %u max %u over %u",
+               frameStats.min(), frameStats.avg(), frameStats.max(), frameStats.overBudget());
+      if (skippedFrames)
+        LOG_INFO(LOG_CAT_DISPLAY, "anim skipped %u frames", skippedFrames);
+      frameStats.reset();
+      skippedFrames = 0;
+    }
+  }
 }
 
 void updateDateTimeTask(void *parameter)
@@ -423,12 +727,13 @@ void updateDateTimeTask(void *parameter)
   int i = 0;
   while (1)
   {
+    ALLOC_SCOPE(ALLOC_CLOCK); // whole pass, getLocalTime included
     i = 0;
-    delay(10);
+    waitForSecondEdge();
     while (!getLocalTime(&timeinfo))
     {
       i++;
-      Serial.println("Failed to obtain time");
+      LOG_WARN(LOG_CAT_CLOCK, "Failed to obtain time");
       if (i > 10)
       {
         esp_restart(); // just reboot and try again
@@ -438,49 +743,122 @@ void updateDateTimeTask(void *parameter)
 
     if (lastsecond != newSecond) // only call if time has changed
     {
-      lastsecond = newSecond;
-      hour = timeinfo.tm_hour;
-      minute = timeinfo.tm_min;
-      second = timeinfo.tm_sec;
-      year = timeinfo.tm_year + 1900;
-      month = timeinfo.tm_mon + 1;
-      day = timeinfo.tm_mday;
+      PowerGuard power(tickLock);
+      publishTime(timeinfo);
     }
   }
 }
+
+// the time for loop() to show, and for the next warm restart
+void publishTime(const struct tm &timeinfo)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  tickEdgeUs = (uint32_t)esp_timer_get_time() - tv.tv_usec; // when the second actually flipped
+  lastsecond = timeinfo.tm_sec;
+  hour = timeinfo.tm_hour;
+  minute = timeinfo.tm_min;
+  second = timeinfo.tm_sec;
+  year = timeinfo.tm_year + 1900;
+  month = timeinfo.tm_mon + 1;
+  day = timeinfo.tm_mday;
+  saveWarmState();
+  if (loopTaskHandle)
+    xTaskNotifyGive(loopTaskHandle);
+}
+
+// warm restart: LedControl has blanked the chips and there is no splash, so the restored time
+// goes straight up rather than after the SD scan and the time task's first second edge
+void showRestoredTime()
+{
+  struct tm timeinfo;
+  if (!getLocalTime(&timeinfo, 0))
+    return;
+  publishTime(timeinfo);
+  DeviceSettings::modes mode = (DeviceSettings::modes)warmState.clockMode;
+  if (mode == DeviceSettings::emulationMode)
+    timeDots = 1;
+  xSemaphoreTake(displayMutex, portMAX_DELAY);
+  display.writeTimeToDisplay(shownHour(mode), minute, second, timeDots);
+  xSemaphoreGive(displayMutex);
+  lastsecondTime = second;
+  LOG_INFO(LOG_CAT_SYS, "warm restart, time back on the display %u ms after reset", millis());
+}
+
+uint8_t shownHour(DeviceSettings::modes mode)
+{
+  if (mode == DeviceSettings::normalMode && settings.twelveHourMode)
+    return hour % 12 == 0 ? 12 : hour % 12;
+  return hour;
+}
+// sleeps until just short of the next whole second of the system clock, then
+// spins through the last moment, so the tick follows the clock (and any sync
+// slew) to within a few us instead of landing somewhere in a 10ms poll
+void waitForSecondEdge()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  time_t start = tv.tv_sec;
+  uint32_t remainingUs = 1000000 - tv.tv_usec;
+  if (remainingUs > 3000)
+    delay((remainingUs - 2000) / 1000);
+  uint32_t spinStart = esp_timer_get_time();
+  do
+  {
+    gettimeofday(&tv, NULL);
+  } while (tv.tv_sec == start && (uint32_t)esp_timer_get_time() - spinStart < 4000); // bounded in case the clock is stepped back
+}
+
 void displayTime()
 {
 
+  ALLOC_SCOPE(ALLOC_DISPLAY);
   if (lastsecondTime != second) // only call if time has changed
   {
     lastsecondTime = second;
-    Serial.printf("%02d/%02d/%d %02d:%02d:%02d\n", month, day, year, hour, minute, second); // debug
+    PowerGuard power(displayLock);
+    ALLOC_CHECK_STEADY_STATE();
+    LOG_DEBUG(LOG_CAT_CLOCK, "%02d/%02d/%d %02d:%02d:%02d", month, day, year, hour, minute, second);
+#if defined(ENABLE_SYNTH) && defined(ENABLE_TICK_SOUND)
+    playTick();
+#endif
     if (xSemaphoreTake(displayMutex, pdMS_TO_TICKS(5)))
     {
-      display.writeTimeToDisplay(hour, minute, second, timeDots);
+      display.writeTimeToDisplay(shownHour(clockMode), minute, second, timeDots);
       xSemaphoreGive(displayMutex);
+      tickToDisplayStats.record((uint32_t)esp_timer_get_time() - tickEdgeUs);
+    }
+    if (tickToDisplayStats.count() >= 60)
+    {
+      LOG_INFO(LOG_CAT_CLOCK, "tick->display us min %u avg %u max %u over %u",
+               tickToDisplayStats.min(), tickToDisplayStats.avg(), tickToDisplayStats.max(), tickToDisplayStats.overBudget());
+      tickToDisplayStats.reset();
     }
   }
 }
 void displayDate()
 {
+  ALLOC_SCOPE(ALLOC_DISPLAY);
   if (millis() > refreshDateDisplayTimer + 1000UL) // write display every second
   {
     refreshDateDisplayTimer = millis();
+    PowerGuard power(displayLock);
     if (xSemaphoreTake(displayMutex, pdMS_TO_TICKS(5)))
     {
       display.writeTimeToSmallDisplay(month, day, 0);
       xSemaphoreGive(displayMutex);
     }
-    Serial.printf("%02d/%02d\n", month, day); // debug
+    LOG_DEBUG(LOG_CAT_CLOCK, "%02d/%02d", month, day);
   }
 }
 
 void displayAlarm()
 {
+  ALLOC_SCOPE(ALLOC_DISPLAY);
   if (millis() > refreshAlarmDisplayTimer + 1000UL) // write display every second
   {
     refreshAlarmDisplayTimer = millis();
+    PowerGuard power(displayLock);
     if (xSemaphoreTake(displayMutex, pdMS_TO_TICKS(5)))
     {
       display.writeTimeToDisplay(alarmHour, alarmMinute, alarmSecond, timeDots);
@@ -493,12 +871,20 @@ void displayAlarm()
 // used in emulation mode only
 void stopWatchTask(void *parameter)
 {
+  ALLOC_SCOPE(ALLOC_CLOCK);
   while (stopWatchRunning)
   {
-    delay(10);
-    if (lastsecondStopWatch != second) // only call if time has changed
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    delay((1000000 - tv.tv_usec) / 1000 + 1); // sleep to just past the next second edge
+    if (!stopWatchRunning) // stopped while asleep
+      break;
+    gettimeofday(&tv, NULL);
+    int nowSecond = tv.tv_sec % 60; // the time task may not have updated second yet
+    if (lastsecondStopWatch != nowSecond) // only call if time has changed
     {
-      lastsecondStopWatch = second;
+      lastsecondStopWatch = nowSecond;
+      PowerGuard power(displayLock);
       stopWatchSecond++;
       if (stopWatchSecond > 59)
       {
@@ -510,14 +896,178 @@ void stopWatchTask(void *parameter)
       if (xSemaphoreTake(displayMutex, pdMS_TO_TICKS(5)))
       {
         display.writeTimeToSmallDisplay(stopWatchMinute, stopWatchSecond, 0);
-        Serial.printf("              %02d:%02d\n", stopWatchMinute, stopWatchSecond);
         xSemaphoreGive(displayMutex);
       }
+      LOG_DEBUG(LOG_CAT_CLOCK, "stopwatch %02d:%02d", stopWatchMinute, stopWatchSecond);
     }
   }
   vTaskDelete(NULL);
 }
 
+// plays a display sequence from the SD card, blocking. false if there is none
+bool playSequence(const char *path)
+{
+#ifdef ENABLE_SEQUENCES
+  File file = assets.open(path); // stays open in the index, don't close
+  if (!file)
+    return false;
+  SoyuzSequence sequence(display);
+  if (!sequence.begin(file))
+  {
+    LOG_WARN(LOG_CAT_DISPLAY, "bad sequence file");
+    return false;
+  }
+  sequence.play();
+  uint32_t us = sequence.readUs();
+  LOG_INFO(LOG_CAT_DISPLAY, "sequence %u frames %u bytes, %u us reading (%u KB/s)", sequence.framesPlayed(),
+           sequence.bytesRead(), us, us ? (uint32_t)((uint64_t)sequence.bytesRead() * 1000 / us) : 0);
+  return true;
+#else
+  return false;
+#endif
+}
+
+#ifdef ENABLE_I2S
+// I2S output behind the mixer. three DMA buffers of one mixer block each,
+// so a new sound reaches the speaker within about 10ms
+void i2sBegin()
+{
+  auto config = i2s.defaultConfig(TX_MODE);
+  config.sample_rate = SoyuzSynth::sampleRate;
+  config.channels = 2;
+  config.bits_per_sample = 16;
+  config.buffer_count = i2sBufferCount;
+  config.buffer_size = SoyuzMixer::blockFrames; // becomes dma_buf_len, which counts frames not bytes
+  config.pin_bck = I2S_BCLK_PIN;
+  config.pin_ws = I2S_LRC_PIN;
+  config.pin_data = I2S_DIN_PIN;
+  i2s.begin(config);
+  pinMode(I2S_SD_PIN, OUTPUT);
+}
+
+// keeps the streamed voice topped up and mixes a block at a time into I2S
+// while any voice is playing. sleeps until a sound is requested otherwise
+void audioTask(void *parameter)
+{
+  static int16_t block[SoyuzMixer::blockFrames * 2];
+  bool playing = false;
+#ifdef ENABLE_SOUND
+  bool streaming = true;
+#endif
+  while (1)
+  {
+#ifdef ENABLE_SOUND
+    if (streaming)
+    {
+      while (mp3Voice.space() >= mp3Headroom && copier.copy())
+        ;
+      if (audioReader.finished()) // the voice plays out what is left in its ring
+      {
+        mp3Voice.finish();
+        audioReader.report();
+        streaming = false;
+      }
+    }
+#endif
+    if (mixer.active())
+    {
+      if (!playing)
+        audioLock.acquire();
+      playing = true;
+      uint32_t requested = soundRequestUs.exchange(0); // taken before mixing, so this block has it
+      mixer.mix(block);
+      i2s.write((uint8_t *)block, sizeof(block)); // blocks until the DMA buffers have room
+      if (requested)
+        soundLatencyStats.record((uint32_t)esp_timer_get_time() - requested);
+      if (soundLatencyStats.count() >= 60)
+      {
+        // at most the DMA queue is still ahead of the block, so that is the worst case to the speaker
+        LOG_INFO(LOG_CAT_AUDIO, "sound request->DMA us min %u avg %u max %u, plus up to %u us queued",
+                 soundLatencyStats.min(), soundLatencyStats.avg(), soundLatencyStats.max(), i2sQueueUs);
+        soundLatencyStats.reset();
+      }
+      continue;
+    }
+    if (playing) // nothing left to play
+    {
+      audioLock.release();
+      playing = false;
+      mixer.report();
+#ifdef ENABLE_SYNTH
+      uint32_t samples = synth.renderedSamples();
+      if (samples) // the tick alone doesn't run the synth
+        LOG_INFO(LOG_CAT_AUDIO, "synth %u samples in %u us, %u.%02u%% of real time", samples, synth.renderUs(),
+                 (uint32_t)((uint64_t)synth.renderUs() * SoyuzSynth::sampleRate / 10000 / samples),
+                 (uint32_t)((uint64_t)synth.renderUs() * SoyuzSynth::sampleRate / 100 / samples % 100));
+      synth.resetStats();
+#endif
+    }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+}
+#endif
+
+#ifdef ENABLE_SYNTH
+void playSound(const SoyuzSynth::Pattern &pattern)
+{
+  synth.play(pattern);
+  soundRequestUs = esp_timer_get_time() | 1; // never 0, that means nothing pending
+  if (audioTaskHandle)
+    xTaskNotifyGive(audioTaskHandle);
+}
+
+// the tick plays every second, so it is synthesized once and mixed from RAM
+void renderTick()
+{
+  const size_t maxFrames = SoyuzSynth::sampleRate / 20; // 50ms
+  tickPcm = (int16_t *)malloc(maxFrames * 4);
+  if (!tickPcm)
+  {
+    LOG_ERROR(LOG_CAT_AUDIO, "no memory for the tick");
+    return;
+  }
+  SoyuzSynth offline; // before the audio task starts, so sharing the wavetable is safe
+  offline.play(SoyuzSynth::tick);
+  while (offline.active() && tickFrames + SoyuzSynth::blockFrames <= maxFrames)
+  {
+    offline.render(tickPcm + tickFrames * 2, SoyuzSynth::blockFrames);
+    tickFrames += SoyuzSynth::blockFrames;
+  }
+}
+
+void playTick()
+{
+  if (!tickPcm)
+    return;
+  clickVoice.play(tickPcm, tickFrames);
+  soundRequestUs = esp_timer_get_time() | 1;
+  if (audioTaskHandle)
+    xTaskNotifyGive(audioTaskHandle);
+}
+#endif
+
+#ifdef SOYUZ_WIFI_STRESS
+// local stand in for heavy WiFi traffic. blasts broadcast UDP from core 0
+// while the tick->display stats show whether core 1 notices
+void wifiStressTask(void *parameter)
+{
+  WiFiUDP udp;
+  static uint8_t payload[1024];
+  while (1)
+  {
+    if (WiFi.status() != WL_CONNECTED)
+    {
+      delay(1000);
+      continue;
+    }
+    udp.beginPacket(IPAddress(255, 255, 255, 255), 9);
+    udp.write(payload, sizeof(payload));
+    udp.endPacket();
+    delay(1); // ~8 Mbit/s, and lets the idle task feed the watchdog
+  }
+}
+#endif
+
 bool setTime(int time[])
 {
   // Array to store current values for each field
@@ -532,12 +1082,12 @@ bool setTime(int time[])
   unsigned long lastIncrementTime = 0; // Timer to control the increment rate
   bool didWeSetTime = false;
 
-  while (fieldIndex < 6 && !digitalRead(RUN_CORRECT_SW_PIN)) // if move back to run mode, exit
+  while (inputs.refresh(), fieldIndex < 6 && inputs.isLow(RUN_CORRECT_SW_PIN)) // if move back to run mode, exit
   {
     // we continute display time until a button press is detected, then we stop
     if (!didWeSetTime)
     {
-      if (digitalRead(OP_SW_PIN)) // current time
+      if (inputs.isHigh(OP_SW_PIN)) // current time
       {
         // updateDateTime();
         displayTime();
@@ -560,7 +1110,7 @@ bool setTime(int time[])
       }
     }
     // Check if the button is pressed (with debouncing)
-    if (digitalRead(ENTER_BUT_PIN) == LOW)
+    if (inputs.isLow(ENTER_BUT_PIN))
     {
       didWeSetTime = true; // if we press button, then the time is set on exit
       if (!buttonPressed)
@@ -568,7 +1118,7 @@ bool setTime(int time[])
         // Button pressed for the first time
         pressStartTime = millis();
         buttonPressed = true;
-        Serial.println("Button pressed");
+        LOG_DEBUG(LOG_CAT_INPUT, "Button pressed");
       }
       else
       {
@@ -582,7 +1132,7 @@ bool setTime(int time[])
             currentValues[fieldIndex] = 0; // Wrap around if exceeding 9
           if (fieldIndex == 1 && currentValues[fieldIndex] > 3 && currentValues[0] == 2)
             currentValues[fieldIndex] = 0;
-          Serial.printf("Field %d value: %d\n", fieldIndex, currentValues[fieldIndex]);
+          LOG_DEBUG(LOG_CAT_INPUT, "Field %d value: %d", fieldIndex, currentValues[fieldIndex]);
           lastIncrementTime = millis();
 
           if (xSemaphoreTake(displayMutex, pdMS_TO_TICKS(5)))
@@ -604,10 +1154,7 @@ bool setTime(int time[])
       {
         // Button was pressed
         fieldIndex++;
-        Serial.printf("Moving to field %d\n", fieldIndex);
-        // Print current field being edited
-        if (fieldIndex < 6)
-          Serial.printf("Editing field %d\n", fieldIndex);
+        LOG_DEBUG(LOG_CAT_INPUT, "Moving to field %d", fieldIndex);
 
         buttonPressed = false;
       }
@@ -626,7 +1173,7 @@ bool setTime(int time[])
     delay(50);
   }
   // if still in correction
-  while (!digitalRead(RUN_CORRECT_SW_PIN))
+  while (inputs.refresh(), inputs.isLow(RUN_CORRECT_SW_PIN))
   {
     // TODO, something. for now just hold execution
   }
@@ -634,6 +1181,88 @@ bool setTime(int time[])
   return didWeSetTime;
 }
 
+// time zone and NTP server from settings, called again whenever they change
+void applyTimeSettings()
+{
+  configTime(settings.gmtOffset_sec, settings.daylightOffset_sec, settings.ntpServer);
+  const char *tz = getenv("TZ");
+  strlcpy(timeZone, tz ? tz : "", sizeof(timeZone));
+}
+
+#ifdef ENABLE_SYNC
+// a follower hands its clock from SNTP to the leader once an exchange has corrected it, SNTP
+// would fight the leader. until then, or if the leader goes quiet, SNTP keeps it set, so a
+// follower with no leader still gets the time rather than restarting over getLocalTime
+void followLeader()
+{
+  bool fromLeader = settings.syncRole == SoyuzSync::follower && clockSync.synced();
+  if (fromLeader && sntp_enabled())
+  {
+    sntp_stop();
+    LOG_INFO(LOG_CAT_NET, "sync: following the leader, SNTP stopped");
+  }
+  else if (!fromLeader && !sntp_enabled())
+  {
+    applyTimeSettings();
+    LOG_INFO(LOG_CAT_NET, "sync: no leader, SNTP started");
+  }
+}
+
+// the role from settings. while syncing, WiFi modem sleep is off: the AP holds frames for
+// a dozing station until the next DTIM beacon, tens of ms on one leg of an exchange only.
+// that costs the idle power modem sleep saves, so it stays on when the role is off
+void applySyncRole()
+{
+  clockSync.setRole((SoyuzSync::Role)settings.syncRole);
+  if (!syncStarted)
+    return;
+  bool sleep = settings.syncRole == SoyuzSync::off;
+  if (WiFi.getSleep() == sleep)
+    return;
+  WiFi.setSleep(sleep);
+  if (sleep)
+    LOG_INFO(LOG_CAT_NET, "sync off, wifi modem sleep back on");
+  else
+    LOG_INFO(LOG_CAT_NET, "sync role %d, wifi modem sleep off while syncing", settings.syncRole);
+}
+#endif
+
+// picks the brightness for the ON switch and schedule, and steps any fade in progress
+void updateBrightness()
+{
+  uint8_t target = 255;
+  uint16_t fadeMs = 2000; // schedule changes fade slowly
+  if (!inputs.isHigh(ON_SW_PIN)) // OFF
+  {
+    target = 0;
+    fadeMs = 300;
+  }
+  else if (inputs.changed(ON_SW_PIN)) // just switched ON
+  {
+    fadeMs = 300;
+  }
+  if (target && clockMode == DeviceSettings::normalMode)
+  {
+    if (settings.displayOffHour != settings.displayOnHour &&
+        isBetweenHours(hour, settings.displayOffHour, settings.displayOnHour))
+    {
+      target = 0;
+    }
+    else if (settings.dimStartHour != settings.dimEndHour &&
+             isBetweenHours(hour, settings.dimStartHour, settings.dimEndHour))
+    {
+      target = constrain(settings.dimLevel, 1, 255);
+    }
+  }
+  brightness.setTarget(target, fadeMs);
+
+  if (brightness.busy() && xSemaphoreTake(displayMutex, 0))
+  {
+    brightness.update();
+    xSemaphoreGive(displayMutex);
+  }
+}
+
 bool isBetweenHours(int hour, int displayOffHour, int displayOnHour)
 {
   // Check if the hour is greater than or equal to displayOffHour
@@ -648,11 +1277,13 @@ bool isBetweenHours(int hour, int displayOffHour, int displayOnHour)
     return (hour >= displayOffHour || hour < displayOnHour);
   }
 }
-uint32_t calculateCRC(const DeviceSettings &settings) // Calculate CRC32 (simple algorithm)
+uint32_t calculateCRC(const DeviceSettings &settings)
+{
+  return calculateCRC(reinterpret_cast<const uint8_t *>(&settings), sizeof(settings));
+}
+uint32_t calculateCRC(const uint8_t *data, int dataSize) // Calculate CRC32 (simple algorithm)
 {
   uint32_t crc = 0;
-  const uint8_t *data = reinterpret_cast<const uint8_t *>(&settings);
-  int dataSize = sizeof(settings);
 
   for (int i = 0; i < dataSize; ++i)
   {
@@ -672,6 +1303,68 @@ uint32_t calculateCRC(const DeviceSettings &settings) // Calculate CRC32 (simple
 
   return crc;
 }
+void saveWarmState()
+{
+  WarmState state;
+  memset(&state, 0, sizeof(state)); // padding is checksummed too
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  state.timeUs = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+  state.rtcUs = esp_rtc_get_time_us();
+  state.clockMode = clockMode;
+  state.alarmEnable = alarmEnable;
+  state.alarm[0] = alarmHour;
+  state.alarm[1] = alarmMinute;
+  state.alarm[2] = alarmSecond;
+  state.stopWatchMode = stopWatchMode;
+  state.stopWatchRunning = stopWatchRunning;
+  state.stopWatchMinute = stopWatchMinute;
+  state.stopWatchSecond = stopWatchSecond;
+  memcpy(state.timeZone, timeZone, sizeof(state.timeZone));
+  state.crc = calculateCRC(reinterpret_cast<const uint8_t *>(&state), offsetof(WarmState, crc));
+  warmState = state;
+}
+bool restoreWarmState() // true if this is a warm restart and the saved state was good
+{
+  esp_reset_reason_t reason = esp_reset_reason();
+  if (reason != ESP_RST_SW && reason != ESP_RST_PANIC && reason != ESP_RST_INT_WDT &&
+      reason != ESP_RST_TASK_WDT && reason != ESP_RST_WDT)
+  {
+    return false; // power on, brownout etc. RTC memory is garbage
+  }
+  WarmState state = warmState;
+  if (state.crc != calculateCRC(reinterpret_cast<const uint8_t *>(&state), offsetof(WarmState, crc)))
+  {
+    return false;
+  }
+  int64_t downUs = esp_rtc_get_time_us() - state.rtcUs;
+  if (downUs < 0 || downUs > 60000000) // RTC was reset too, or the state is stale
+  {
+    return false;
+  }
+  int64_t nowUs = state.timeUs + downUs;
+  struct timeval tv = {(time_t)(nowUs / 1000000), (suseconds_t)(nowUs % 1000000)};
+  settimeofday(&tv, NULL);
+  if (state.timeZone[0] && memchr(state.timeZone, '\0', sizeof(state.timeZone)))
+  {
+    memcpy(timeZone, state.timeZone, sizeof(timeZone));
+    setenv("TZ", timeZone, 1);
+    tzset();
+  }
+  alarmEnable = state.alarmEnable;
+  alarmHour = state.alarm[0];
+  alarmMinute = state.alarm[1];
+  alarmSecond = state.alarm[2];
+  stopWatchMode = state.stopWatchMode;
+  stopWatchRunning = state.stopWatchRunning;
+  uint32_t stopWatchSeconds = state.stopWatchMinute * 60 + state.stopWatchSecond;
+  if (stopWatchRunning)
+    stopWatchSeconds += (downUs + 500000) / 1000000; // it kept running while we were down
+  stopWatchMinute = stopWatchSeconds / 60 % 100;
+  stopWatchSecond = stopWatchSeconds % 60;
+  LOG_INFO(LOG_CAT_SYS, "warm restart, reset reason %d, down %d ms", reason, (int32_t)(downUs / 1000));
+  return true;
+}
 bool readEEPROMWithCRC(DeviceSettings &settings) // Read EEPROM and verify CRC
 {
   uint32_t storedCRC;
@@ -704,89 +1397,311 @@ void writeEEPROMWithCRC(const DeviceSettings &settings) // Write EEPROM with CRC
 
 #ifdef ENABLE_WIFI
 WiFiManager wm;
-String getParam(String name)
+
+// the portal keeps pointers to these, so they live as long as wm does. the radio groups are
+// html the portal shows as is, rebuilt by fillPortalFields with the current choice checked
+char defaultModeHtml[192];
+char twelveHourHtml[192];
+char transitionHtml[320];
+WiFiManagerParameter ntpServerCustomField("ntp_server", "NTP Server", "pool.ntp.org", 50);
+WiFiManagerParameter gmtOffsetCustomField("gmt_offset", "GMT Offset (secs) - EST default", "-18000", 50);
+WiFiManagerParameter daylightOffsetCustomField("daylightOffset", "Daylight Time Offset (secs)", "3600", 50);
+WiFiManagerParameter defaultModeCustomField(defaultModeHtml); // custom html input
+WiFiManagerParameter twelveHourCustomField(twelveHourHtml);   // custom html input
+WiFiManagerParameter dimStartCustomField("dim_start", "Dim display from hour (normal mode)", "22", 3);
+WiFiManagerParameter dimEndCustomField("dim_end", "Dim display until hour", "7", 3);
+WiFiManagerParameter offStartCustomField("off_start", "Display off from hour (same as until = never)", "0", 3);
+WiFiManagerParameter offEndCustomField("off_end", "Display off until hour", "0", 3);
+WiFiManagerParameter dimLevelCustomField("dim_level", "Dim brightness (1-255)", "60", 4);
+WiFiManagerParameter transitionCustomField(transitionHtml); // custom html input
+#ifdef ENABLE_SYNC
+char syncRoleHtml[320];
+WiFiManagerParameter syncRoleCustomField(syncRoleHtml); // custom html input
+#endif
+
+// one radio per option, valued by its index
+void radioHtml(char *html, size_t size, const char *name, const char *label, const char *const options[], int count,
+               int checked)
 {
-  // read parameter from server, for customhmtl input
-  String value;
+  int n = snprintf(html, size, "<br/><label for='%s'>%s<br></label>", name, label);
+  for (int i = 0; i < count && n < (int)size; i++)
+    n += snprintf(html + n, size - n, "%s<input type='radio' name='%s' value='%d'%s> %s", i ? "<br>" : "", name, i,
+                  i == checked ? " checked" : "", options[i]);
+}
+
+// the portal's fields show what is saved, so a save only changes what the user touched
+void fillPortalFields()
+{
+  char value[12];
+  ntpServerCustomField.setValue(settings.ntpServer, 50);
+  snprintf(value, sizeof(value), "%ld", settings.gmtOffset_sec);
+  gmtOffsetCustomField.setValue(value, 50);
+  snprintf(value, sizeof(value), "%d", settings.daylightOffset_sec);
+  daylightOffsetCustomField.setValue(value, 50);
+  snprintf(value, sizeof(value), "%d", settings.dimStartHour);
+  dimStartCustomField.setValue(value, 3);
+  snprintf(value, sizeof(value), "%d", settings.dimEndHour);
+  dimEndCustomField.setValue(value, 3);
+  snprintf(value, sizeof(value), "%d", settings.displayOffHour);
+  offStartCustomField.setValue(value, 3);
+  snprintf(value, sizeof(value), "%d", settings.displayOnHour);
+  offEndCustomField.setValue(value, 3);
+  snprintf(value, sizeof(value), "%d", settings.dimLevel);
+  dimLevelCustomField.setValue(value, 4);
+
+  static const char *const modes[] = {"Emulation", "normal"};
+  radioHtml(defaultModeHtml, sizeof(defaultModeHtml), "defaultmode", "Default Mode on bootup", modes, 2,
+            settings.defualtMode == DeviceSettings::emulationMode ? 0 : 1);
+  static const char *const hours[] = {"12", "24"};
+  radioHtml(twelveHourHtml, sizeof(twelveHourHtml), "twelveHourMode", "Hour Display for normal mdoe", hours, 2,
+            settings.twelveHourMode ? 0 : 1);
+  static const char *const transitions[] = {"None", "Wipe", "Roll", "Flicker"};
+  radioHtml(transitionHtml, sizeof(transitionHtml), "transition", "Digit transition", transitions, 4,
+            settings.digitTransition);
+#ifdef ENABLE_SYNC
+  static const char *const roles[] = {"Off", "Leader", "Follower"};
+  radioHtml(syncRoleHtml, sizeof(syncRoleHtml), "sync_role", "Sync seconds with other clocks (keeps WiFi awake, uses more power)",
+            roles, SoyuzSync::num_roles, settings.syncRole);
+#endif
+}
+
+void getParam(const char *name, char *value, size_t valueSize)
+{
+  // copy parameter from server into value, for customhmtl input. empty if not sent
+  value[0] = '\0';
   if (wm.server->hasArg(name))
   {
-    value = wm.server->arg(name);
+    strlcpy(value, wm.server->arg(name).c_str(), valueSize);
   }
-  return value;
 }
 
 void saveParamCallback()
 {
+  ALLOC_SCOPE(ALLOC_SETTINGS);
+  char value[sizeof(settings.ntpServer)];
 
   Serial.println("[CALLBACK] saveParamCallback fired");
-  Serial.printf("ntp: %s\n", getParam("ntp_server"));
-  Serial.printf("Offset: %s\n", getParam("gmt_offset"));
-  Serial.printf("Daylight: %s\n", getParam("daylightOffset"));
 
-  Serial.println("defaultmode = " + getParam("defaultmode"));
-  Serial.println("twelvehourmpde= " + getParam("twelveHourMode"));
-
-  settings.twelveHourMode = ((char)getParam("twelveHourMode")[0] == '0');
-  String ntpServerValue = getParam("ntp_server");
-  if (!ntpServerValue.isEmpty())
+  getParam("twelveHourMode", value, sizeof(value));
+  settings.twelveHourMode = (value[0] == '0');
+  getParam("ntp_server", value, sizeof(value));
+  if (value[0] != '\0')
   {
-    ntpServerValue.toCharArray(settings.ntpServer, sizeof(settings.ntpServer));
+    strlcpy(settings.ntpServer, value, sizeof(settings.ntpServer));
   }
-  settings.gmtOffset_sec = getParam("gmt_offset").toInt();
-  settings.daylightOffset_sec = getParam("daylightOffset").toInt();
-  settings.defualtMode = ((char)getParam("defaultmode")[0] == '0' ? DeviceSettings::emulationMode : DeviceSettings::normalMode);
+  getParam("gmt_offset", value, sizeof(value));
+  settings.gmtOffset_sec = atol(value);
+  getParam("daylightOffset", value, sizeof(value));
+  settings.daylightOffset_sec = atoi(value);
+  getParam("defaultmode", value, sizeof(value));
+  settings.defualtMode = (value[0] == '0' ? DeviceSettings::emulationMode : DeviceSettings::normalMode);
+  getParam("dim_start", value, sizeof(value));
+  settings.dimStartHour = atoi(value);
+  getParam("dim_end", value, sizeof(value));
+  settings.dimEndHour = atoi(value);
+  getParam("off_start", value, sizeof(value));
+  settings.displayOffHour = atoi(value);
+  getParam("off_end", value, sizeof(value));
+  settings.displayOnHour = atoi(value);
+  getParam("dim_level", value, sizeof(value));
+  settings.dimLevel = atoi(value);
+  getParam("transition", value, sizeof(value));
+  settings.digitTransition = atoi(value);
+  animator.setTransition((SoyuzAnimator::Transition)settings.digitTransition);
+#ifdef ENABLE_SYNC
+  getParam("sync_role", value, sizeof(value));
+  int syncRole = atoi(value);
+  settings.syncRole = syncRole >= 0 && syncRole < SoyuzSync::num_roles ? syncRole : SoyuzSync::off;
+  applySyncRole();
+#endif
+  if (clockMode == DeviceSettings::normalMode)
+    applyTimeSettings(); // new zone and server take effect from the next tick, 12/24h is read on every tick
+
+  Serial.printf("ntp: %s\n", settings.ntpServer);
+  Serial.printf("Offset: %ld\n", settings.gmtOffset_sec);
+  Serial.printf("Daylight: %d\n", settings.daylightOffset_sec);
+  Serial.printf("defaultmode = %d\n", settings.defualtMode);
+  Serial.printf("twelvehourmode = %d\n", settings.twelveHourMode);
 
   writeEEPROMWithCRC(settings);
   EEPROM.commit();
+  fillPortalFields(); // the radios are not posted back by id, the next page load needs them checked again
 }
-bool wifiManagerSetup(bool adhoc)
+#ifdef ENABLE_API
+void apiRoutes()
 {
-  WiFi.mode(WIFI_STA); // explicitly set mode, esp defaults to STA+AP
-  Serial.setDebugOutput(true);
+  api.on("/api/time", [](char *out, size_t size)
+         { return snprintf(out, size, "{\"hour\":%u,\"minute\":%u,\"second\":%u,\"year\":%d,\"month\":%u,\"day\":%u,\"mode\":\"%s\"}",
+                           hour, minute, second, year, month, day,
+                           clockMode == DeviceSettings::normalMode ? "normal" : "emulation"); });
+  api.on(
+      "/api/alarm", [](char *out, size_t size)
+      { return snprintf(out, size, "{\"enabled\":%s,\"hour\":%u,\"minute\":%u,\"second\":%u}",
+                        alarmEnable ? "true" : "false", alarmHour, alarmMinute, alarmSecond); },
+      [](WebServer &server)
+      {
+        int h, m, sec;
+        if (!SoyuzApi::intArg(server, "hour", 0, 23, h) || !SoyuzApi::intArg(server, "minute", 0, 59, m) ||
+            !SoyuzApi::intArg(server, "second", 0, 59, sec))
+          return false;
+        apiAlarm[0] = h;
+        apiAlarm[1] = m;
+        apiAlarm[2] = sec;
+        apiAlarmSet = true;
+        xTaskNotifyGive(loopTaskHandle);
+        return true;
+      });
+  api.on(
+      "/api/stopwatch", [](char *out, size_t size)
+      { return snprintf(out, size, "{\"mode\":%d,\"running\":%s,\"minute\":%u,\"second\":%u}",
+                        stopWatchMode, stopWatchRunning ? "true" : "false", stopWatchMinute, stopWatchSecond); },
+      [](WebServer &server)
+      {
+        apiStopWatchPress = true; // same as pressing START/STOP: start, stop, reset
+        xTaskNotifyGive(loopTaskHandle);
+        return true;
+      });
+  api.on("/api/settings", [](char *out, size_t size)
+         {
+           char ntpServer[sizeof(settings.ntpServer) * 2]; // typed into the portal, so anything can be in it
+           return snprintf(out, size, "{\"twelveHourMode\":%s,\"ntpServer\":\"%s\",\"gmtOffset\":%ld,\"daylightOffset\":%d,"
+                                      "\"defaultMode\":%d,\"dimStart\":%d,\"dimEnd\":%d,\"offStart\":%d,\"offEnd\":%d,"
+                                      "\"dimLevel\":%d,\"transition\":%d,\"syncRole\":%d}",
+                           settings.twelveHourMode ? "true" : "false",
+                           SoyuzApi::jsonEscape(settings.ntpServer, ntpServer, sizeof(ntpServer)), settings.gmtOffset_sec,
+                           settings.daylightOffset_sec, settings.defualtMode, settings.dimStartHour, settings.dimEndHour,
+                           settings.displayOffHour, settings.displayOnHour, settings.dimLevel, settings.digitTransition,
+                           settings.syncRole); });
+  api.on("/api/telemetry", [](char *out, size_t size)
+         { return snprintf(out, size, "{\"uptimeMs\":%lu,\"freeHeap\":%u,\"minFreeHeap\":%u,\"rssi\":%d,"
+                                      "\"logDropped\":%u,\"frameVersion\":%u,\"wsClients\":%u}",
+                           millis(), ESP.getFreeHeap(), ESP.getMinFreeHeap(), WiFi.RSSI(),
+                           SoyuzLog::droppedCount(), display.frameVersion(), api.clientCount()); });
+}
+
+// alarm and stopwatch changes from the API, done here the same way the switches and buttons do them
+void applyApiRequests()
+{
+  if (!apiAlarmSet)
+    return;
+  apiAlarmSet = false;
+  alarmEnable = true;
+  alarmHour = apiAlarm[0];
+  alarmMinute = apiAlarm[1];
+  alarmSecond = apiAlarm[2];
+  if (clockMode == DeviceSettings::normalMode)
+  {
+    settings.normalModeAlarm[0] = alarmHour;
+    settings.normalModeAlarm[1] = alarmMinute;
+    settings.normalModeAlarm[2] = alarmSecond;
+    writeEEPROMWithCRC(settings);
+    EEPROM.commit();
+  }
+}
+#endif
 
-  WiFiManagerParameter ntpServerCustomField;
-  WiFiManagerParameter gmtOffsetCustomField;
-  WiFiManagerParameter daylightOffsetCustomField;
-  WiFiManagerParameter defaultModeCustomField;
-  WiFiManagerParameter twelveHourCustomField;
+void wifiManagerSetup()
+{
+  Serial.setDebugOutput(true);
   wm.setClass("invert"); // dark mode
   wm.setParamsPage(true);
-
-  new (&ntpServerCustomField) WiFiManagerParameter("ntp_server", "NTP Server", "pool.ntp.org", 50);
-  new (&gmtOffsetCustomField) WiFiManagerParameter("gmt_offset", "GMT Offset (secs) - EST default", "-18000", 50);
-  new (&daylightOffsetCustomField) WiFiManagerParameter("daylightOffset", "Daylight Time Offset (secs)", "3600", 50);
-
-  const char *defaultModeCustomField_str = "<br/><label for='defaultmode'>Default Mode on bootup<br></label><input type='radio' name='defaultmode' value='0' checked> Emulation<br><input type='radio' name='defaultmode' value='1'> normal";
-  new (&defaultModeCustomField) WiFiManagerParameter(defaultModeCustomField_str); // custom html input
-
-  const char *twelveHourCustomField_str = "<br/><label for='twelveHourMode'>Hour Display for normal mdoe<br></label><input type='radio' name='twelveHourMode' value='0' checked> 12<br><input type='radio' name='twelveHourMode' value='1'> 24";
-  new (&twelveHourCustomField) WiFiManagerParameter(twelveHourCustomField_str); // custom html input
+  fillPortalFields();
 
   wm.addParameter(&ntpServerCustomField);
   wm.addParameter(&gmtOffsetCustomField);
   wm.addParameter(&daylightOffsetCustomField);
   wm.addParameter(&defaultModeCustomField);
   wm.addParameter(&twelveHourCustomField);
+  wm.addParameter(&dimStartCustomField);
+  wm.addParameter(&dimEndCustomField);
+  wm.addParameter(&offStartCustomField);
+  wm.addParameter(&offEndCustomField);
+  wm.addParameter(&dimLevelCustomField);
+  wm.addParameter(&transitionCustomField);
+#ifdef ENABLE_SYNC
+  wm.addParameter(&syncRoleCustomField);
+#endif
 
   wm.setSaveParamsCallback(saveParamCallback);
-  wm.setConfigPortalBlocking(true);
-  bool res = true;
-  if (adhoc)
+  wm.setConfigPortalBlocking(false); // wm.process() in the network task does the serving
+}
+
+// owns WiFiManager. connects with the saved credentials, leaving the "Soyuz" AP
+// portal up if that fails, and serves the settings pages on the LAN once connected.
+// saveParamCallback runs from here, so settings land without touching core 1
+void networkTask(void *parameter)
+{
+  wifiManagerSetup();
+  if (!wm.autoConnect("Soyuz"))
   {
-    wm.startConfigPortal("Soyuz");
+    LOG_WARN(LOG_CAT_NET, "wifi connect failed, portal open on the Soyuz AP");
   }
-  else
+  bool webPortal = false;
+#ifdef ENABLE_API
+  uint32_t frameVersionSent = 0;
+  uint8_t frame[SoyuzApi::frameSize];
+#endif
+  while (1)
   {
-    res = wm.autoConnect("Soyuz");
-    if (!res)
+    if (portalRequested)
     {
-      Serial.println("Failed to connect");
+      portalRequested = false;
+      if (webPortal)
+        wm.stopWebPortal();
+      webPortal = false;
+      LOG_INFO(LOG_CAT_NET, "adhoc config portal");
+      wm.startConfigPortal("Soyuz"); // returns straight away, process() serves it
     }
-    else
+    if (!webPortal && !wm.getConfigPortalActive() && WiFi.isConnected())
     {
-      Serial.println("connected.");
+      wm.startWebPortal(); // settings reachable at the clock's address
+      webPortal = true;
+      LOG_INFO(LOG_CAT_NET, "connected, settings portal on the LAN");
+#ifdef ENABLE_API
+      api.begin(); // first connect only, later calls are ignored
+#endif
+#ifdef ENABLE_SYNC
+      if (!syncStarted && clockMode == DeviceSettings::normalMode)
+      {
+        syncStarted = clockSync.begin(syncTaskConfig);
+        applySyncRole();
+      }
+#endif
     }
+#ifdef ENABLE_SYNC
+    if (syncStarted) // normal mode only, SNTP is never on in emulation mode
+      followLeader();
+#endif
+    wm.process();
+#ifdef ENABLE_API
+    api.handle();
+    // every display write holds displayMutex, so a copy under it is a whole frame. never
+    // waits on core 1, if the clock is mid update this pass skips and the next one sends
+    if (display.frameVersion() != frameVersionSent && xSemaphoreTake(displayMutex, 0))
+    {
+      frameVersionSent = display.frameVersion();
+      memcpy(frame, display.frameBuffer(), sizeof(frame));
+      xSemaphoreGive(displayMutex);
+      api.pushFrame(frame);
+    }
+#endif
+    delay(10);
+  }
+}
+
+// ENTER held for 5 seconds from power on opens the adhoc portal, without stopping the clock
+void checkPortalHold()
+{
+  if (!portalHoldArmed)
+    return;
+  if (!inputs.isLow(ENTER_BUT_PIN))
+  {
+    portalHoldArmed = false; // let go early, normal boot
+  }
+  else if (millis() - portalHoldStart > 5000UL)
+  {
+    portalHoldArmed = false;
+    portalRequested = true;
   }
-  return res;
 }
 #endif
@@ -0,0 +1,47 @@
+/*
+  Host side of the stubs in stub/, linked into every test.
+*/
+
+#include "Arduino.h"
+#include "esp_timer.h"
+#include <chrono>
+#include <thread>
+
+bool hostFakeTime = false;
+static unsigned long fakeMillis = 0;
+thread_local void *hostTaskContext = NULL;
+
+unsigned long millis()
+{
+  if (hostFakeTime)
+    return fakeMillis;
+  return esp_timer_get_time() / 1000;
+}
+
+void delay(unsigned long ms)
+{
+  if (hostFakeTime)
+    fakeMillis += ms;
+  else
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+int64_t esp_timer_get_time()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void runTask(TaskFunction_t task, void *parameter, void *context)
+{
+  hostTaskContext = context;
+  task(parameter);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *, uint32_t, void *parameter, UBaseType_t,
+                                   TaskHandle_t *handle, BaseType_t)
+{
+  std::thread(runTask, task, parameter, hostTaskContext).detach(); // tasks outlive main's scope, like on the device
+  if (handle)
+    *handle = NULL;
+  return pdPASS;
+}
@@ -0,0 +1,37 @@
+// just enough of the Arduino core to build the portable libraries on the host
+#ifndef HostArduino_h
+#define HostArduino_h
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "WString.h"
+
+typedef uint8_t byte;
+
+// real time by default. a test that sets hostFakeTime drives millis() itself,
+// through delay(), so timed playback runs as fast as the host can
+extern bool hostFakeTime;
+unsigned long millis();
+void delay(unsigned long ms);
+
+// FreeRTOS tasks are host threads. each starts with the hostTaskContext of the
+// thread that created it, for stubs that need per device state
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+#define pdPASS 1
+extern thread_local void *hostTaskContext;
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name, uint32_t stackSize, void *parameter,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core);
+
+class Stream
+{
+public:
+  virtual ~Stream() {}
+  virtual size_t readBytes(uint8_t *buffer, size_t length) = 0;
+};
+
+#endif
@@ -0,0 +1,19 @@
+// stands in for the MAX7219 driver, keeps the segment byte last written to each position
+#ifndef HostSoyuzDisplay_h
+#define HostSoyuzDisplay_h
+#include "Arduino.h"
+
+class SoyuzDisplay
+{
+public:
+  uint8_t segments[10] = {0};
+  uint32_t writes = 0;
+
+  void writeSegments(int position, uint8_t value)
+  {
+    segments[position] = value;
+    writes++;
+  }
+};
+
+#endif
@@ -0,0 +1,19 @@
+// the log macros straight to stdout, levels and categories are not filtered
+#ifndef HostSoyuzLog_h
+#define HostSoyuzLog_h
+#include <stdio.h>
+
+#define LOG_CAT_SYS 0
+#define LOG_CAT_CLOCK 0
+#define LOG_CAT_DISPLAY 0
+#define LOG_CAT_INPUT 0
+#define LOG_CAT_NET 0
+#define LOG_CAT_AUDIO 0
+
+#define HOST_LOG(level, cat, fmt, ...) printf(level " " fmt "\n", ##__VA_ARGS__)
+#define LOG_ERROR(cat, fmt, ...) HOST_LOG("E", cat, fmt, ##__VA_ARGS__)
+#define LOG_WARN(cat, fmt, ...) HOST_LOG("W", cat, fmt, ##__VA_ARGS__)
+#define LOG_INFO(cat, fmt, ...) HOST_LOG("I", cat, fmt, ##__VA_ARGS__)
+#define LOG_DEBUG(cat, fmt, ...) HOST_LOG("D", cat, fmt, ##__VA_ARGS__)
+
+#endif
@@ -0,0 +1,20 @@
+// the few String calls the libraries make, over std::string
+#ifndef HostWString_h
+#define HostWString_h
+#include <stdlib.h>
+#include <string>
+
+class String
+{
+public:
+  String(const char *text = "") : text(text) {}
+  unsigned int length() const { return text.size(); }
+  char operator[](unsigned int index) const { return text[index]; }
+  long toInt() const { return atol(text.c_str()); }
+  const char *c_str() const { return text.c_str(); }
+
+private:
+  std::string text;
+};
+
+#endif
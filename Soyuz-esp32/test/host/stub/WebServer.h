@@ -0,0 +1,79 @@
+// stands in for the Arduino WebServer. no sockets: request() runs the handler the real
+// server would pick for a method and uri, and keeps what it sent
+#ifndef HostWebServer_h
+#define HostWebServer_h
+#include "Arduino.h"
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+enum HTTPMethod
+{
+  HTTP_ANY,
+  HTTP_GET,
+  HTTP_POST
+};
+
+class WebServer
+{
+public:
+  typedef std::function<void(void)> THandlerFunction;
+
+  WebServer(int) { last = this; }
+  void on(const char *uri, HTTPMethod method, THandlerFunction handler) { handlers.push_back({uri, method, handler}); }
+  void onNotFound(THandlerFunction handler) { notFound = handler; }
+  void begin() {}
+  void handleClient() {}
+
+  bool hasArg(const char *name) const { return args.count(name) != 0; }
+  String arg(const char *name) const { return hasArg(name) ? String(args.at(name).c_str()) : String(); }
+  void send(int code, const char *type = NULL, const char *body = "")
+  {
+    sentCode = code;
+    sentType = type ? type : "";
+    sentBody = body;
+  }
+  void send_P(int code, const char *type, const char *body, size_t length)
+  {
+    send(code, type, std::string(body, length).c_str());
+  }
+
+  // host side. last is the server constructed most recently, for reaching one a library owns.
+  // request() returns the status code sent, 0 if the handler sent nothing
+  static WebServer *last;
+  int request(HTTPMethod method, const char *uri, const std::map<std::string, std::string> &fields = {})
+  {
+    args = fields;
+    sentCode = 0;
+    sentType.clear();
+    sentBody.clear();
+    for (size_t i = 0; i < handlers.size(); i++)
+    {
+      if (handlers[i].uri == uri && (handlers[i].method == HTTP_ANY || handlers[i].method == method))
+      {
+        handlers[i].handler();
+        return sentCode;
+      }
+    }
+    if (notFound)
+      notFound();
+    return sentCode;
+  }
+  int sentCode = 0;
+  std::string sentType;
+  std::string sentBody;
+
+private:
+  struct Handler
+  {
+    std::string uri;
+    HTTPMethod method;
+    THandlerFunction handler;
+  };
+  std::vector<Handler> handlers;
+  THandlerFunction notFound;
+  std::map<std::string, std::string> args;
+};
+
+#endif
@@ -0,0 +1,57 @@
+// stands in for the WebSockets library server. connect() and disconnect() raise the events
+// a client would, and the frames sent are kept
+#ifndef HostWebSocketsServer_h
+#define HostWebSocketsServer_h
+#include "Arduino.h"
+#include <functional>
+#include <vector>
+
+enum WStype_t
+{
+  WStype_DISCONNECTED,
+  WStype_CONNECTED,
+  WStype_BIN
+};
+
+class WebSocketsServer
+{
+public:
+  typedef std::function<void(uint8_t num, WStype_t type, uint8_t *payload, size_t length)> WebSocketServerEvent;
+
+  WebSocketsServer(uint16_t) { last = this; }
+  void onEvent(WebSocketServerEvent handler) { event = handler; }
+  void begin() {}
+  void loop() {}
+  uint8_t connectedClients() const { return clients; }
+  bool sendBIN(uint8_t num, const uint8_t *data, size_t length)
+  {
+    sent.push_back(Sent{num, std::vector<uint8_t>(data, data + length)});
+    return true;
+  }
+  bool broadcastBIN(const uint8_t *data, size_t length) { return sendBIN(255, data, length); }
+
+  // host side, last is the server constructed most recently
+  static WebSocketsServer *last;
+  struct Sent
+  {
+    uint8_t num; // 255 for a broadcast
+    std::vector<uint8_t> data;
+  };
+  std::vector<Sent> sent;
+  void connect(uint8_t num)
+  {
+    clients++;
+    event(num, WStype_CONNECTED, NULL, 0);
+  }
+  void disconnect(uint8_t num)
+  {
+    clients--;
+    event(num, WStype_DISCONNECTED, NULL, 0);
+  }
+
+private:
+  WebSocketServerEvent event;
+  uint8_t clients = 0;
+};
+
+#endif
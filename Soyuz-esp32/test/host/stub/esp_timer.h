@@ -0,0 +1,8 @@
+// host esp_timer_get_time, the real monotonic clock so the libraries' own timing means something
+#ifndef HostEspTimer_h
+#define HostEspTimer_h
+#include <stdint.h>
+
+int64_t esp_timer_get_time();
+
+#endif
@@ -0,0 +1,16 @@
+// lwip's BSD socket API is the host's. sends go through hostSendto, so a test
+// can put a network path (delay, loss) between the clocks it runs
+#ifndef HostLwipSockets_h
+#define HostLwipSockets_h
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+
+ssize_t hostSendto(int sock, const void *data, size_t length, int flags, const struct sockaddr *to, socklen_t toLength);
+#define sendto hostSendto
+
+#endif
@@ -0,0 +1,113 @@
+/*
+  Drives SoyuzApi through stub servers: route dispatch, the 202/400/404/500
+  answers, intArg's checks, jsonEscape and the frames pushed to WebSocket
+  clients. The routes are shaped like the ones main.cpp registers.
+
+    test_api
+*/
+
+#include "Arduino.h"
+#include "SoyuzApi.h"
+
+WebServer *WebServer::last = NULL;
+WebSocketsServer *WebSocketsServer::last = NULL;
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+  printf("%-60s %s\n", what, ok ? "ok" : "FAIL");
+  failures += !ok;
+}
+
+static int alarmSet[3];
+
+static int writeTime(char *out, size_t size) { return snprintf(out, size, "{\"hour\":12}"); }
+
+static int writeTooLong(char *out, size_t size) { return snprintf(out, size, "%*s", (int)size, "x"); }
+
+static bool postAlarm(WebServer &server)
+{
+  int h, m, s;
+  if (!SoyuzApi::intArg(server, "hour", 0, 23, h) || !SoyuzApi::intArg(server, "minute", 0, 59, m) ||
+      !SoyuzApi::intArg(server, "second", 0, 59, s))
+    return false;
+  alarmSet[0] = h;
+  alarmSet[1] = m;
+  alarmSet[2] = s;
+  return true;
+}
+
+static bool acceptAll(WebServer &) { return true; }
+
+static int postAlarmFields(WebServer &http, const char *hour, const char *minute, const char *second)
+{
+  std::map<std::string, std::string> fields;
+  if (hour)
+    fields["hour"] = hour;
+  if (minute)
+    fields["minute"] = minute;
+  if (second)
+    fields["second"] = second;
+  return http.request(HTTP_POST, "/api/alarm", fields);
+}
+
+int main()
+{
+  SoyuzApi api;
+  WebServer &http = *WebServer::last;
+  WebSocketsServer &ws = *WebSocketsServer::last;
+
+  check(api.on("/api/time", writeTime), "register a GET route");
+  check(api.on("/api/alarm", writeTime, postAlarm), "register a GET and POST route");
+  check(api.on("/api/long", writeTooLong), "register a route that overflows");
+  for (int i = 3; i < SoyuzApi::maxRoutes; i++)
+    api.on("/api/spare", writeTime, acceptAll);
+  check(!api.on("/api/one-too-many", writeTime), "on() refuses routes past maxRoutes");
+
+  check(http.request(HTTP_GET, "/api/time") == 0, "nothing is served before begin()");
+  api.begin();
+  api.begin(); // a second call is ignored, it would register every route again
+
+  check(http.request(HTTP_GET, "/api/time") == 200 && http.sentBody == "{\"hour\":12}" &&
+            http.sentType == "application/json",
+        "GET answers 200 with the writer's JSON");
+  check(http.request(HTTP_GET, "/api/nothing") == 404, "unknown uri answers 404");
+  check(http.request(HTTP_POST, "/api/time") == 404, "POST to a GET only route answers 404");
+  check(http.request(HTTP_GET, "/api/long") == 500, "response too long for the buffer answers 500");
+
+  check(postAlarmFields(http, "7", "30", "0") == 202 && http.sentBody.empty() && alarmSet[0] == 7 &&
+            alarmSet[1] == 30 && alarmSet[2] == 0,
+        "valid POST answers 202 with no body and reaches the handler");
+  alarmSet[0] = -1;
+  check(postAlarmFields(http, "7", "30", NULL) == 400 && alarmSet[0] == -1, "missing field answers 400");
+  check(postAlarmFields(http, "24", "0", "0") == 400, "out of range answers 400");
+  check(postAlarmFields(http, "-1", "0", "0") == 400, "negative answers 400");
+  check(postAlarmFields(http, "7a", "0", "0") == 400, "trailing junk answers 400");
+  check(postAlarmFields(http, "", "0", "0") == 400, "empty field answers 400");
+  check(postAlarmFields(http, "0000000007", "0", "0") == 400, "more than 9 digits answers 400");
+  check(postAlarmFields(http, "23", "59", "59") == 202, "the top of each range is accepted");
+
+  char out[32];
+  check(strcmp(SoyuzApi::jsonEscape("pool.ntp.org", out, sizeof(out)), "pool.ntp.org") == 0,
+        "jsonEscape leaves plain text alone");
+  check(strcmp(SoyuzApi::jsonEscape("a\"b\\c\n", out, sizeof(out)), "a\\\"b\\\\c\\u000a") == 0,
+        "jsonEscape escapes quotes, backslashes and control characters");
+  check(strcmp(SoyuzApi::jsonEscape("ab\"", out, 4), "ab") == 0, "jsonEscape cuts before a half escape");
+
+  uint8_t frame[SoyuzApi::frameSize] = {1, 2, 3};
+  api.pushFrame(frame);
+  check(ws.sent.empty(), "no clients, nothing broadcast");
+  ws.connect(0);
+  check(ws.sent.size() == 1 && ws.sent[0].num == 0 && ws.sent[0].data == std::vector<uint8_t>(frame, frame + 10),
+        "a new client gets the current frame");
+  api.pushFrame(frame);
+  check(ws.sent.size() == 1, "an unchanged frame is not sent again");
+  frame[9] = 0x80;
+  api.pushFrame(frame);
+  check(ws.sent.size() == 2 && ws.sent[1].num == 255 && ws.sent[1].data[9] == 0x80, "a changed frame is broadcast");
+  ws.disconnect(0);
+
+  printf("%s\n", failures ? "FAIL" : "all ok");
+  return failures ? 1 : 0;
+}
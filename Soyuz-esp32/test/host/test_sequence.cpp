@@ -0,0 +1,127 @@
+/*
+  Plays a .sq file through SoyuzSequence onto the recording display and prints
+  every frame the way "soyuzseq.py decode" does, duration then hex:<segments>.
+  The duration is how long the frame stayed up on the fake clock, so it checks
+  the player's timing as well as the decoding.
+
+  --speed plays a generated file of zero length frames, every position changing
+  in each, on the real clock and reports frames/s and bytes/s. It fails under
+  minFramesPerSecond, far above the 1 frame/ms a sequence can ask for, so what
+  it catches is a change that makes the decode loop much slower.
+
+    test_sequence <file.sq>
+    test_sequence --speed [frames]      default 1000000 frames
+*/
+
+#include "Arduino.h"
+#include "SoyuzSequence.h"
+#include "esp_timer.h"
+
+static const uint32_t minFramesPerSecond = 100000;
+static const uint32_t frameBytes = 4 + 10; // duration, mask, all 10 positions
+
+class FileStream : public Stream
+{
+public:
+  FileStream(FILE *f) : file(f) {}
+  size_t readBytes(uint8_t *buffer, size_t length) { return fread(buffer, 1, length, file); }
+
+private:
+  FILE *file;
+};
+
+static void printFrame(unsigned long duration, const uint8_t *segments)
+{
+  printf("%lu hex:", duration);
+  for (int i = 0; i < 10; i++)
+    printf("%02x", segments[i]);
+  printf("\n");
+}
+
+static int speed(uint32_t count)
+{
+  FILE *f = tmpfile();
+  if (!f)
+  {
+    perror("tmpfile");
+    return 2;
+  }
+  uint8_t header[8] = {'S', 'O', 'Y', 'Q', 1, 0, 0, 0}; // frame count 0, until end of file
+  fwrite(header, 1, sizeof(header), f);
+  for (uint32_t i = 0; i < count; i++)
+  {
+    uint8_t frame[frameBytes] = {0, 0, 0xff, 0x03};
+    for (int p = 0; p < 10; p++)
+      frame[4 + p] = (uint8_t)(i + p);
+    fwrite(frame, 1, sizeof(frame), f);
+  }
+  rewind(f);
+
+  FileStream in(f);
+  SoyuzDisplay display;
+  SoyuzSequence sequence(display);
+  int64_t start = esp_timer_get_time();
+  bool ok = sequence.begin(in);
+  while (ok && sequence.update())
+  {
+  }
+  uint32_t us = esp_timer_get_time() - start;
+  fclose(f);
+  uint32_t framesPerSecond = us ? (uint64_t)sequence.framesPlayed() * 1000000 / us : 0;
+  uint32_t bytesPerSecond = us ? (uint64_t)sequence.bytesRead() * 1000000 / us : 0;
+  ok = ok && sequence.framesPlayed() == count && display.writes == count * 10 && framesPerSecond >= minFramesPerSecond;
+  printf("played %u frames, %u bytes in %u us (%u us reading): %u frames/s, %u KB/s, limit %u frames/s%s\n",
+         sequence.framesPlayed(), sequence.bytesRead(), us, sequence.readUs(), framesPerSecond, bytesPerSecond / 1024,
+         minFramesPerSecond, ok ? "" : "  FAIL");
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc >= 2 && strcmp(argv[1], "--speed") == 0)
+    return speed(argc > 2 ? atoi(argv[2]) : 1000000);
+  if (argc != 2)
+  {
+    fprintf(stderr, "usage: test_sequence <file.sq>\n       test_sequence --speed [frames]\n");
+    return 2;
+  }
+  hostFakeTime = true; // frame durations come out exact and playback takes no real time
+  FILE *f = fopen(argv[1], "rb");
+  if (!f)
+  {
+    perror(argv[1]);
+    return 2;
+  }
+  FileStream in(f);
+  SoyuzDisplay display;
+  SoyuzSequence sequence(display);
+  if (!sequence.begin(in))
+  {
+    fprintf(stderr, "bad header or no frames\n");
+    return 1;
+  }
+
+  uint8_t shown[10];
+  memcpy(shown, display.segments, sizeof(shown));
+  unsigned long shownAt = millis();
+  uint32_t frame = sequence.framesPlayed();
+  while (true)
+  {
+    bool playing = sequence.update();
+    if (!playing || sequence.framesPlayed() != frame)
+    {
+      printFrame(millis() - shownAt, shown);
+      if (!playing)
+        break;
+      memcpy(shown, display.segments, sizeof(shown));
+      shownAt = millis();
+      frame = sequence.framesPlayed();
+      continue; // a zero length frame is replaced without any time passing
+    }
+    delay(1);
+  }
+  fprintf(stderr, "%u frames, %u bytes, %u segment writes\n", sequence.framesPlayed(), sequence.bytesRead(),
+          display.writes);
+  fclose(f);
+  return 0;
+}
@@ -0,0 +1,232 @@
+/*
+  Runs one SoyuzSync leader and several followers on this host, each on its
+  own simulated system clock, over real sockets. The clocks start out of
+  phase and drift, and every packet is held back on its way like on WiFi:
+  multicast beacons by several ms (power save holds them to the next DTIM),
+  unicast by 1-3 ms each way with jitter. Every 5 seconds it prints how far
+  apart the clocks' second edges are, and fails unless the followers end up
+  within the 1 ms target of the leader and of each other. It also fails if
+  the follower that starts 3 s out steps more than once, any other follower
+  steps at all or doesn't report synced, or a correction used a negative
+  round trip.
+
+    test_sync [followers] [seconds]      default 4 followers, 60 seconds
+*/
+
+#include "Arduino.h"
+#include "SoyuzSync.h"
+#include "esp_timer.h"
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+static const int32_t multicastDelayUs = 6000, multicastJitterUs = 4000;
+static const int32_t unicastDelayUs = 1000, unicastJitterUs = 2000;
+static const int32_t targetUs = 1000;
+
+// host monotonic time plus an offset, a drift and any adjtime in progress. the
+// slew rate is ESP-IDF's, 1/64 of the time elapsed (ADJTIME_CORRECTION_FACTOR)
+class SimClock
+{
+public:
+  SimClock(int64_t offsetUs, int32_t driftPpm)
+      : base(esp_timer_get_time()), offset(offsetUs), drift(driftPpm), slewLeft(0), slewFrom(base) {}
+
+  int64_t now() { return at(esp_timer_get_time()); }
+
+  int64_t at(int64_t host)
+  {
+    std::lock_guard<std::mutex> hold(lock);
+    applySlew(host);
+    return host + offset + (host - base) * drift / 1000000;
+  }
+
+  void step(int64_t toUs)
+  {
+    std::lock_guard<std::mutex> hold(lock);
+    int64_t host = esp_timer_get_time();
+    applySlew(host);
+    offset += toUs - (host + offset + (host - base) * drift / 1000000);
+    slewLeft = 0;
+  }
+
+  int64_t slew(const int64_t *deltaUs) // replaces whatever is left of the last one, like adjtime. returns that
+  {
+    std::lock_guard<std::mutex> hold(lock);
+    applySlew(esp_timer_get_time());
+    int64_t left = slewLeft;
+    if (deltaUs)
+      slewLeft = *deltaUs;
+    return left;
+  }
+
+private:
+  void applySlew(int64_t host)
+  {
+    int64_t gap = (host - slewFrom) >> 6;
+    if (host > slewFrom)
+      slewFrom = host;
+    if (llabs(slewLeft) <= gap)
+    {
+      offset += slewLeft;
+      slewLeft = 0;
+    }
+    else
+    {
+      offset += slewLeft > 0 ? gap : -gap;
+      slewLeft += slewLeft > 0 ? -gap : gap;
+    }
+  }
+
+  std::mutex lock;
+  int64_t base;
+  int64_t offset;
+  int32_t drift;
+  int64_t slewLeft;
+  int64_t slewFrom;
+};
+
+// the system clock calls in SoyuzSync land here, on the clock of the device whose task is calling
+static SimClock *deviceClock() { return static_cast<SimClock *>(hostTaskContext); }
+
+extern "C" int gettimeofday(struct timeval *__restrict tv, void *__restrict) __THROW
+{
+  int64_t us = deviceClock() ? deviceClock()->now() : esp_timer_get_time();
+  tv->tv_sec = us / 1000000;
+  tv->tv_usec = us % 1000000;
+  return 0;
+}
+
+extern "C" int settimeofday(const struct timeval *tv, const struct timezone *) __THROW
+{
+  deviceClock()->step((int64_t)tv->tv_sec * 1000000 + tv->tv_usec);
+  return 0;
+}
+
+extern "C" int adjtime(const struct timeval *delta, struct timeval *left) __THROW
+{
+  int64_t deltaUs = delta ? (int64_t)delta->tv_sec * 1000000 + delta->tv_usec : 0;
+  int64_t leftUs = deviceClock()->slew(delta ? &deltaUs : NULL);
+  if (left)
+  {
+    left->tv_sec = leftUs / 1000000;
+    left->tv_usec = leftUs % 1000000;
+  }
+  return 0;
+}
+
+static std::mutex randomLock;
+static std::mt19937 randomSource(1);
+
+static int32_t randomUs(int32_t range)
+{
+  std::lock_guard<std::mutex> hold(randomLock);
+  return std::uniform_int_distribution<int32_t>(0, range)(randomSource);
+}
+
+static void deliver(int sock, std::vector<uint8_t> data, int flags, struct sockaddr_storage to, socklen_t toLength,
+                    int32_t delayUs)
+{
+  std::this_thread::sleep_for(std::chrono::microseconds(delayUs));
+  ::sendto(sock, data.data(), data.size(), flags, (struct sockaddr *)&to, toLength);
+}
+
+// the network: every packet leaves after its path delay, without holding up the sender
+ssize_t hostSendto(int sock, const void *data, size_t length, int flags, const struct sockaddr *to, socklen_t toLength)
+{
+  const struct sockaddr_in *in = (const struct sockaddr_in *)to;
+  bool multicast = IN_MULTICAST(ntohl(in->sin_addr.s_addr));
+  int32_t delayUs = multicast ? multicastDelayUs + randomUs(multicastJitterUs) : unicastDelayUs + randomUs(unicastJitterUs);
+  struct sockaddr_storage copy = {};
+  memcpy(&copy, to, toLength);
+  const uint8_t *bytes = (const uint8_t *)data;
+  std::thread(deliver, sock, std::vector<uint8_t>(bytes, bytes + length), flags, copy, toLength, delayUs).detach();
+  return length;
+}
+
+// every clock read at the same host instant, as offsets from the leader
+static int64_t spread(std::vector<SimClock *> &clocks, std::vector<int64_t> &offsets)
+{
+  int64_t host = esp_timer_get_time();
+  int64_t leader = clocks[0]->at(host), low = 0, high = 0;
+  offsets.clear();
+  for (size_t i = 1; i < clocks.size(); i++)
+  {
+    int64_t offset = clocks[i]->at(host) - leader;
+    offsets.push_back(offset);
+    low = offset < low ? offset : low;
+    high = offset > high ? offset : high;
+  }
+  return high - low;
+}
+
+int main(int argc, char **argv)
+{
+  int followers = argc > 1 ? atoi(argv[1]) : 4;
+  int seconds = argc > 2 ? atoi(argv[2]) : 60;
+  setvbuf(stdout, NULL, _IOLBF, 0);
+
+  std::mt19937 setup(2);
+  std::vector<SimClock *> clocks;
+  std::vector<SoyuzSync *> syncs;
+  clocks.push_back(new SimClock(0, 0));
+  for (int i = 0; i < followers; i++)
+  {
+    // one follower starts seconds out, so the first exchange has to step it
+    int64_t offset = i == 0 ? 3000000 : std::uniform_int_distribution<int64_t>(-80000, 80000)(setup);
+    clocks.push_back(new SimClock(offset, std::uniform_int_distribution<int32_t>(-20, 20)(setup)));
+  }
+  for (size_t i = 0; i < clocks.size(); i++)
+  {
+    SoyuzSync *sync = new SoyuzSync(); // runs until exit, like on the device
+    syncs.push_back(sync);
+    hostTaskContext = clocks[i];       // the sync task runs on this clock
+    if (!sync->begin(syncTaskConfig))
+    {
+      printf("sync begin failed for clock %u\n", (unsigned)i);
+      return 1;
+    }
+    sync->setRole(i == 0 ? SoyuzSync::leader : SoyuzSync::follower);
+  }
+  hostTaskContext = NULL;
+
+  std::vector<int64_t> offsets;
+  int64_t worst = 0;
+  bool badDelay = false;
+  for (int t = 5; t <= seconds; t += 5)
+  {
+    std::this_thread::sleep_for(std::chrono::seconds(5));
+    int64_t now = spread(clocks, offsets);
+    printf("%3ds  spread %8lld us  offsets from leader:", t, (long long)now);
+    int64_t furthest = now;
+    for (size_t i = 0; i < offsets.size(); i++)
+    {
+      printf(" %lld", (long long)offsets[i]);
+      furthest = llabs(offsets[i]) > furthest ? llabs(offsets[i]) : furthest;
+      badDelay = badDelay || syncs[i + 1]->lastDelayUs() < 0;
+    }
+    printf("\n");
+    if (t > seconds - 20) // settled by now, the last 20 seconds all have to be on target
+      worst = furthest > worst ? furthest : worst;
+  }
+  bool ok = worst < targetUs;
+  printf("worst over the last 20 s %lld us, target %d us%s\n", (long long)worst, targetUs, ok ? "" : "  FAIL");
+  for (size_t i = 1; i < syncs.size(); i++)
+  {
+    uint32_t expected = i == 1 ? 1 : 0; // only the follower that started 3 s out
+    bool followerOk = syncs[i]->stepCount() == expected && syncs[i]->synced();
+    printf("follower %u stepped %u times, expected %u, %s%s\n", (unsigned)i, syncs[i]->stepCount(), expected,
+           syncs[i]->synced() ? "synced" : "not synced", followerOk ? "" : "  FAIL");
+    ok = ok && followerOk;
+  }
+  if (badDelay)
+    printf("a correction used a negative round trip  FAIL\n");
+  ok = ok && !badDelay;
+  fflush(stdout);
+  _exit(ok ? 0 : 1); // the device tasks never return
+}
@@ -0,0 +1,149 @@
+/*
+  Checks every SoyuzSynth pattern renders without clipping and ends on time,
+  and that the gains of notes sounding together stay within 255, then times a
+  long render. The timing is for this host, the device figure
+  comes from the audio task's "synth ... of real time" log line; what this
+  catches is a change that makes the per sample loop slower.
+
+    test_synth [seconds]      seconds of audio to time, default 60
+*/
+
+#include "Arduino.h"
+#include "SoyuzSynth.h"
+#include "esp_timer.h"
+
+struct Result
+{
+  uint32_t frames; // until the synth went idle
+  int peak;
+  bool stereo;     // both channels identical
+};
+
+static Result renderAll(SoyuzSynth &synth, const SoyuzSynth::Pattern &pattern, uint32_t limitFrames)
+{
+  int16_t block[SoyuzSynth::blockFrames * 2];
+  Result result = {0, 0, true};
+  synth.play(pattern);
+  while (synth.active() && result.frames < limitFrames)
+  {
+    synth.render(block, SoyuzSynth::blockFrames);
+    result.frames += SoyuzSynth::blockFrames;
+    for (int i = 0; i < SoyuzSynth::blockFrames; i++)
+    {
+      int s = abs(block[i * 2]);
+      if (s > result.peak)
+        result.peak = s;
+      if (block[i * 2] != block[i * 2 + 1])
+        result.stereo = false;
+    }
+  }
+  return result;
+}
+
+// the longest a pattern can sound: its last note's start, length and release
+static uint32_t patternFrames(const SoyuzSynth::Pattern &pattern)
+{
+  uint32_t longest = 0;
+  for (int i = 0; i < pattern.count; i++)
+  {
+    const SoyuzSynth::Note &note = pattern.notes[i];
+    uint32_t end = note.startMs + note.lengthMs + note.releaseMs;
+    if (end > longest)
+      longest = end;
+  }
+  return longest * SoyuzSynth::sampleRate / 1000 + SoyuzSynth::blockFrames * 2; // notes start on block boundaries
+}
+
+// the most gain sounding at once. the busiest moments are when notes start
+static int overlappingGain(const SoyuzSynth::Pattern &pattern)
+{
+  int most = 0;
+  for (int i = 0; i < pattern.count; i++)
+  {
+    uint32_t at = pattern.notes[i].startMs;
+    int gain = 0;
+    for (int j = 0; j < pattern.count; j++)
+    {
+      const SoyuzSynth::Note &note = pattern.notes[j];
+      if (note.startMs <= at && at < (uint32_t)note.startMs + note.lengthMs + note.releaseMs)
+        gain += note.gain;
+    }
+    most = gain > most ? gain : most;
+  }
+  return most;
+}
+
+int main(int argc, char **argv)
+{
+  struct
+  {
+    const char *name;
+    const SoyuzSynth::Pattern &pattern;
+  } patterns[] = {{"beep", SoyuzSynth::beep}, {"chime", SoyuzSynth::chime},
+                  {"alarm", SoyuzSynth::alarm}, {"tick", SoyuzSynth::tick}};
+  int failures = 0;
+
+  for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++)
+  {
+    SoyuzSynth synth;
+    uint32_t expected = patternFrames(patterns[i].pattern);
+    Result r = renderAll(synth, patterns[i].pattern, expected * 2);
+    int gain = overlappingGain(patterns[i].pattern);
+    bool ok = r.frames <= expected && r.peak > 1000 && r.peak < 32767 && gain <= 255 && r.stereo && !synth.active();
+    printf("%-6s %6u frames (limit %u), peak %5d, gain %3d%s%s\n", patterns[i].name, r.frames, expected, r.peak,
+           gain, r.peak >= 32767 ? " clipped" : "", ok ? "" : "  FAIL");
+    failures += !ok;
+  }
+
+  // the envelope: full after the attack, down to the sustain level after the decay
+  {
+    static const SoyuzSynth::Note note[] = {{0, 1000, 500, SoyuzSynth::sine, 200, 10, 100, 128, 100}};
+    static const SoyuzSynth::Pattern adsr = {note, 1};
+    SoyuzSynth synth;
+    int16_t block[SoyuzSynth::blockFrames * 2];
+    int attackPeak = 0, sustainPeak = 0;
+    synth.play(adsr);
+    for (uint32_t f = 0; f < SoyuzSynth::sampleRate * 4 / 10; f += SoyuzSynth::blockFrames)
+    {
+      synth.render(block, SoyuzSynth::blockFrames);
+      for (int i = 0; i < SoyuzSynth::blockFrames; i++)
+      {
+        int s = abs(block[i * 2]);
+        if (f < SoyuzSynth::sampleRate / 50) // the first 20 ms
+          attackPeak = s > attackPeak ? s : attackPeak;
+        else if (f >= SoyuzSynth::sampleRate / 5) // 200 ms on, long after the decay
+          sustainPeak = s > sustainPeak ? s : sustainPeak;
+      }
+    }
+    int full = 32767 * 200 / 256, sustained = full * 128 / 255;
+    bool ok = abs(attackPeak - full) < full / 50 && abs(sustainPeak - sustained) < full / 50;
+    printf("adsr   peak %5d (expect %d), sustain %5d (expect %d)%s\n", attackPeak, full, sustainPeak, sustained,
+           ok ? "" : "  FAIL");
+    failures += !ok;
+  }
+
+  // a chime every second with all four voices busy, the worst the clock asks for
+  uint32_t seconds = argc > 1 ? atoi(argv[1]) : 60;
+  SoyuzSynth synth;
+  int16_t block[SoyuzSynth::blockFrames * 2];
+  uint32_t frames = 0;
+  int64_t start = esp_timer_get_time();
+  for (uint32_t s = 0; s < seconds; s++)
+  {
+    synth.play(SoyuzSynth::chime);
+    for (uint32_t f = 0; f < SoyuzSynth::sampleRate; f += SoyuzSynth::blockFrames)
+    {
+      synth.render(block, SoyuzSynth::blockFrames);
+      frames += SoyuzSynth::blockFrames;
+    }
+  }
+  uint32_t us = esp_timer_get_time() - start;
+  printf("render %u frames in %u us, %u ksamples/s, %.3f%% of real time on this host\n", frames, us,
+         us ? (uint32_t)((uint64_t)frames * 1000 / us) : 0, us * 100.0 * SoyuzSynth::sampleRate / 1e6 / frames);
+  if (synth.renderedSamples() != frames)
+  {
+    printf("renderedSamples %u, expected %u  FAIL\n", synth.renderedSamples(), frames);
+    failures++;
+  }
+  return failures ? 1 : 0;
+}
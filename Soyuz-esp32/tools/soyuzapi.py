@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+"""Local client for the SoyuzClock control API, see lib/SoyuzApi.
+
+    soyuzapi.py <host> get time|alarm|stopwatch|settings|telemetry
+    soyuzapi.py <host> alarm <hour> <minute> <second>
+    soyuzapi.py <host> stopwatch              same as pressing START/STOP
+    soyuzapi.py <host> watch                  prints every display frame pushed
+                                              over the WebSocket, as hex
+"""
+
+import base64
+import os
+import socket
+import struct
+import sys
+import urllib.parse
+import urllib.request
+
+HTTP_PORT = 8080
+WS_PORT = 8081
+
+
+def request(host, path, fields=None):
+    url = "http://%s:%d/api/%s" % (host, HTTP_PORT, path)
+    data = urllib.parse.urlencode(fields).encode() if fields is not None else None
+    with urllib.request.urlopen(url, data=data, timeout=5) as response:
+        if response.status == 202:  # POSTs are applied by the clock's loop, read back with get
+            return "accepted"
+        return response.read().decode()
+
+
+def recv_exact(sock, n):
+    data = b""
+    while len(data) < n:
+        chunk = sock.recv(n - len(data))
+        if not chunk:
+            raise ConnectionError("connection closed")
+        data += chunk
+    return data
+
+
+def watch(host):
+    sock = socket.create_connection((host, WS_PORT), timeout=30)
+    key = base64.b64encode(os.urandom(16)).decode()
+    sock.sendall(("GET / HTTP/1.1\r\nHost: %s:%d\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                  "Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n\r\n" % (host, WS_PORT, key)).encode())
+    header = b""
+    while b"\r\n\r\n" not in header:
+        header += recv_exact(sock, 1)
+    if b" 101 " not in header.split(b"\r\n")[0]:
+        sys.exit("handshake failed: %s" % header.split(b"\r\n")[0].decode())
+    while True:
+        first, length = recv_exact(sock, 2)
+        length &= 0x7F
+        if length == 126:
+            length = struct.unpack(">H", recv_exact(sock, 2))[0]
+        elif length == 127:
+            length = struct.unpack(">Q", recv_exact(sock, 8))[0]
+        payload = recv_exact(sock, length)
+        opcode = first & 0x0F
+        if opcode == 0x2:  # binary, one display frame
+            print(payload.hex())
+        elif opcode == 0x8:
+            return
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit(__doc__)
+    host, command = sys.argv[1], sys.argv[2]
+    if command == "get" and len(sys.argv) == 4:
+        print(request(host, sys.argv[3]))
+    elif command == "alarm" and len(sys.argv) == 6:
+        print(request(host, "alarm", {"hour": sys.argv[3], "minute": sys.argv[4], "second": sys.argv[5]}))
+    elif command == "stopwatch":
+        print(request(host, "stopwatch", {}))
+    elif command == "watch":
+        watch(host)
+    else:
+        sys.exit(__doc__)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""Encode/decode SoyuzClock display sequences (.sq), see lib/SoyuzSequence.
+
+Source files are text, one frame per line, lines starting with '#' are comments:
+
+    <duration ms> "<text>"        up to 10 characters, position 0 first, like
+                                  writeStringToDisplay. a '.' lights the dot of
+                                  the character before it
+    <duration ms> hex:<20 hex>    raw segment bytes for positions 0-9
+
+    soyuzseq.py encode boot.txt boot.sq
+    soyuzseq.py decode boot.sq          prints the frames back as hex: lines
+
+test/host/run.sh plays what this encodes through the C++ player and diffs the frames.
+"""
+
+import struct
+import sys
+
+# myCharTable from SoyuzDisplay.h
+CHAR_TABLE = [
+    0x7e, 0x30, 0x6d, 0x79, 0x33, 0x5b, 0x5f, 0x70, 0x7f, 0x7b, 0x77, 0x1f, 0x0d, 0x3d, 0x4f, 0x47,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x01, 0x80, 0x00,
+    0x7e, 0x30, 0x6d, 0x79, 0x33, 0x5b, 0x5f, 0x70, 0x7f, 0x7b, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x77, 0x1f, 0x0d, 0x3d, 0x4f, 0x47, 0x00, 0x37, 0x30, 0x00, 0x00, 0x0e, 0x00, 0x00, 0x1d,
+    0x67, 0x00, 0x05, 0x5b, 0x70, 0x1c, 0x00, 0x00, 0x00, 0x3b, 0x6d, 0x5b, 0x00, 0x00, 0x00, 0x08,
+    0x00, 0x77, 0x1f, 0x0d, 0x3d, 0x4f, 0x47, 0x00, 0x37, 0x30, 0x00, 0x00, 0x0e, 0x00, 0x15, 0x1d,
+    0x67, 0x00, 0x05, 0x5b, 0x00, 0x1c, 0x00, 0x00, 0x00, 0x3b, 0x6d, 0x00, 0x00, 0x00, 0x00, 0x00,
+]
+
+MAGIC = b"SOYQ"
+VERSION = 1
+
+
+def text_to_image(text):
+    image = []
+    for c in text:
+        if c == "." and image:
+            image[-1] |= 0x80
+            continue
+        image.append(CHAR_TABLE[ord(c)] if ord(c) < 128 else 0)
+    if len(image) > 10:
+        raise ValueError("more than 10 characters: %r" % text)
+    return image + [0] * (10 - len(image))
+
+
+def parse(path):
+    frames = []
+    with open(path) as f:
+        for number, line in enumerate(f, 1):
+            line = line.strip()
+            if not line or line.startswith("#"):
+                continue
+            duration, _, rest = line.partition(" ")
+            rest = rest.strip()
+            try:
+                if rest.startswith("hex:"):
+                    image = list(bytes.fromhex(rest[4:]))
+                    if len(image) != 10:
+                        raise ValueError("need 10 segment bytes")
+                elif rest.startswith('"') and rest.endswith('"'):
+                    image = text_to_image(rest[1:-1])
+                else:
+                    raise ValueError("expected \"text\" or hex:")
+                duration = int(duration)
+                if not 0 <= duration <= 0xFFFF:
+                    raise ValueError("duration out of range")
+            except ValueError as e:
+                sys.exit("%s:%d: %s" % (path, number, e))
+            frames.append((duration, image))
+    return frames
+
+
+def encode(frames):
+    out = bytearray(MAGIC + struct.pack("<BBH", VERSION, 0, len(frames)))
+    previous = [0] * 10
+    for duration, image in frames:
+        mask = 0
+        changed = bytearray()
+        for i in range(10):
+            if image[i] != previous[i]:
+                mask |= 1 << i
+                changed.append(image[i])
+        out += struct.pack("<HH", duration, mask) + changed
+        previous = image
+    return bytes(out)
+
+
+def decode(data):
+    if data[:4] != MAGIC or data[4] != VERSION:
+        raise ValueError("not a version %d sequence" % VERSION)
+    (count,) = struct.unpack_from("<H", data, 6)
+    pos = 8
+    image = [0] * 10
+    frames = []
+    while pos + 4 <= len(data) and (count == 0 or len(frames) < count):
+        duration, mask = struct.unpack_from("<HH", data, pos)
+        pos += 4
+        for i in range(10):
+            if mask & (1 << i):
+                image[i] = data[pos]
+                pos += 1
+        frames.append((duration, list(image)))
+    return frames
+
+
+def main():
+    if len(sys.argv) == 4 and sys.argv[1] == "encode":
+        data = encode(parse(sys.argv[2]))
+        with open(sys.argv[3], "wb") as f:
+            f.write(data)
+    elif len(sys.argv) == 3 and sys.argv[1] == "decode":
+        with open(sys.argv[2], "rb") as f:
+            for duration, image in decode(f.read()):
+                print("%d hex:%s" % (duration, bytes(image).hex()))
+    else:
+        sys.exit(__doc__)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,43 @@
+#!/usr/bin/env python3
+"""Watch SoyuzClock second sync traffic on the LAN, see lib/SoyuzSync.
+
+Prints each leader beacon as it arrives, with the leader's stamp against this
+host's clock. The stamp is only there to identify the beacon. Followers time
+themselves with unicast exchanges, which a listener can't see.
+
+    soyuzsync.py              print beacons seen on the LAN
+
+test/host/test_sync runs the firmware's sync code itself, a leader and
+followers on one host with WiFi-like path delays.
+"""
+
+import socket
+import struct
+import time
+
+GROUP = "239.255.83.89"
+PORT = 5315
+PACKET = struct.Struct("<4sBBBB6I")  # magic, version, type, sequence, reserved, origin/receive/transmit sec+usec
+VERSION = 2
+BEACON = 0
+
+
+def listen():
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(("", PORT))
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, socket.inet_aton(GROUP) + socket.inet_aton("0.0.0.0"))
+    while True:
+        data, sender = sock.recvfrom(64)
+        rx = time.time()
+        if len(data) != PACKET.size:
+            continue
+        magic, version, kind, sequence, _, _, _, _, _, sec, usec = PACKET.unpack(data)
+        if magic != b"SOYS" or version != VERSION or kind != BEACON:
+            continue
+        print("%s:%d seq %3d  stamp %d.%06d  host - stamp %+.6f s" % (sender[0], sender[1], sequence, sec, usec,
+                                                                       rx - sec - usec / 1e6))
+
+
+if __name__ == "__main__":
+    listen()